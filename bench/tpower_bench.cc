@@ -0,0 +1,254 @@
+/*  =========================================================================
+    tpower_bench - Throughput of the metric ingest path on synthetic topologies
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// @file   tpower_bench.cc
+/// @brief  Benchmark of TotalPowerConfiguration on synthetic topologies
+///
+/// Topology of size N has N racks powered by epdus and N/10 (at least 1) DCs powered by UPSes,
+/// each unit has D power devices. Batches of metrics (epdu realpower.default, UPS realpower
+/// and input voltage/current) are processed like metrics read from the shared memory.
+
+#include "src/tpowerconfiguration.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <getopt.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Options
+{
+    std::vector<size_t> units      = {10, 100, 1000, 10000, 50000};
+    std::vector<size_t> devices    = {1, 10, 100, 500};
+    size_t              maxDevices = 1000000; ///< bigger topologies are skipped
+    size_t              batchSize  = 1000;    ///< metrics per batch
+    size_t              batches    = 200;     ///< measured batches per topology
+};
+
+struct Metric
+{
+    std::string element;
+    std::string quantity;
+    std::string units;
+};
+
+struct Result
+{
+    double metricsPerSecond      = 0;
+    double calculationsPerSecond = 0;
+    double p50                   = 0; ///< [us]
+    double p99                   = 0; ///< [us]
+    long   rss                   = 0; ///< [kB]
+};
+
+/// resident set size of the process [kB]
+long s_rss()
+{
+    long  pages = 0, resident = 0;
+    FILE* f     = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+std::vector<size_t> s_parseList(const char* arg)
+{
+    std::vector<size_t> result;
+    std::string         list(arg);
+    size_t              start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        if (end > start) {
+            result.push_back(size_t(std::stoul(list.substr(start, end - start))));
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+/// build the topology and the pool of metrics its devices produce
+void s_buildTopology(size_t units, size_t devices, PowerTopology& racks, PowerTopology& dcs, std::vector<Metric>& pool)
+{
+    static const char* upsQuantities[][2] = {{"realpower.default", "W"}, {"realpower.input.L1", "W"},
+        {"realpower.input.L2", "W"}, {"realpower.input.L3", "W"}, {"realpower.output.L1", "W"},
+        {"realpower.output.L2", "W"}, {"realpower.output.L3", "W"}, {"voltage.input.L1-N", "V"},
+        {"voltage.input.L2-N", "V"}, {"voltage.input.L3-N", "V"}, {"current.input.L1", "A"},
+        {"current.input.L2", "A"}, {"current.input.L3", "A"}};
+
+    for (size_t rack = 0; rack < units; ++rack) {
+        auto& list = racks["rack-" + std::to_string(rack)];
+        for (size_t device = 0; device < devices; ++device) {
+            std::string name = "epdu-" + std::to_string(rack) + "-" + std::to_string(device);
+            pool.push_back({name, "realpower.default", "W"});
+            list.push_back(std::move(name));
+        }
+    }
+    size_t dcCount = std::max(units / 10, size_t(1));
+    for (size_t dc = 0; dc < dcCount; ++dc) {
+        auto& list = dcs["datacenter-" + std::to_string(dc)];
+        for (size_t device = 0; device < devices; ++device) {
+            std::string name = "ups-" + std::to_string(dc) + "-" + std::to_string(device);
+            for (const auto& quantity : upsQuantities) {
+                pool.push_back({name, quantity[0], quantity[1]});
+            }
+            list.push_back(std::move(name));
+        }
+    }
+}
+
+Result s_run(size_t units, size_t devices, const Options& options)
+{
+    uint64_t                published = 0;
+    TotalPowerConfiguration config([&published](const MetricInfo&) {
+        published++;
+        return true;
+    });
+
+    PowerTopology       racks, dcs;
+    std::vector<Metric> pool;
+    s_buildTopology(units, devices, racks, dcs, pool);
+    config.loadTopology(racks, dcs);
+
+    std::mt19937                          random(42);
+    std::uniform_int_distribution<size_t> pick(0, pool.size() - 1);
+    std::uniform_real_distribution<>      value(100, 1000);
+
+    auto runBatch = [&]() {
+        uint64_t now = uint64_t(::time(nullptr));
+        config.beginBatch();
+        for (size_t i = 0; i < options.batchSize; ++i) {
+            const Metric& metric = pool[pick(random)];
+            config.processMetric(MetricSample(metric.element, metric.quantity, metric.units, value(random), now, 300));
+        }
+        config.endBatch();
+    };
+
+    // every device reports at least once, so the measured batches see the steady state
+    uint64_t now = uint64_t(::time(nullptr));
+    config.beginBatch();
+    for (const auto& metric : pool) {
+        config.processMetric(MetricSample(metric.element, metric.quantity, metric.units, value(random), now, 300));
+    }
+    config.endBatch();
+
+    std::vector<double> latencies;
+    latencies.reserve(options.batches);
+    uint64_t calculations = config.publishStats().calculations;
+    auto     start        = std::chrono::steady_clock::now();
+    for (size_t batch = 0; batch < options.batches; ++batch) {
+        auto begin = std::chrono::steady_clock::now();
+        runBatch();
+        latencies.push_back(
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    calculations   = config.publishStats().calculations - calculations;
+
+    Result result;
+    std::sort(latencies.begin(), latencies.end());
+    if (!latencies.empty()) {
+        result.p50 = latencies[latencies.size() / 2];
+        result.p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    }
+    if (seconds > 0) {
+        result.metricsPerSecond      = double(options.batches * options.batchSize) / seconds;
+        result.calculationsPerSecond = double(calculations) / seconds;
+    }
+    result.rss = s_rss();
+    return result;
+}
+
+void s_usage(const char* name)
+{
+    printf("Usage: %s [options]\n", name);
+    printf("  -u, --units LIST       racks per topology (default 10,100,1000,10000,50000)\n");
+    printf("  -d, --devices LIST     power devices per rack and DC (default 1,10,100,500)\n");
+    printf("  -m, --max-devices N    skip topologies with more devices (default 1000000)\n");
+    printf("  -b, --batch N          metrics per batch (default 1000)\n");
+    printf("  -n, --batches N        measured batches per topology (default 200)\n");
+    printf("  -h, --help             this help\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+
+    static const struct option longOptions[] = {{"units", required_argument, nullptr, 'u'},
+        {"devices", required_argument, nullptr, 'd'}, {"max-devices", required_argument, nullptr, 'm'},
+        {"batch", required_argument, nullptr, 'b'}, {"batches", required_argument, nullptr, 'n'},
+        {"help", no_argument, nullptr, 'h'}, {nullptr, 0, nullptr, 0}};
+
+    int c;
+    while ((c = getopt_long(argc, argv, "u:d:m:b:n:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'u':
+                options.units = s_parseList(optarg);
+                break;
+            case 'd':
+                options.devices = s_parseList(optarg);
+                break;
+            case 'm':
+                options.maxDevices = size_t(std::stoul(optarg));
+                break;
+            case 'b':
+                options.batchSize = std::max(size_t(std::stoul(optarg)), size_t(1));
+                break;
+            case 'n':
+                options.batches = std::max(size_t(std::stoul(optarg)), size_t(1));
+                break;
+            case 'h':
+            default:
+                s_usage(argv[0]);
+                return (c == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    printf("%8s %8s %10s %14s %14s %10s %10s %10s\n", "units", "devices", "total", "metrics/s", "calcs/s",
+        "p50 [us]", "p99 [us]", "RSS [kB]");
+    for (size_t units : options.units) {
+        for (size_t devices : options.devices) {
+            size_t total = (units + std::max(units / 10, size_t(1))) * devices;
+            if ((units == 0) || (devices == 0) || (total > options.maxDevices)) {
+                continue;
+            }
+            Result result = s_run(units, devices, options);
+            printf("%8zu %8zu %10zu %14.0f %14.0f %10.1f %10.1f %10ld\n", units, devices, total,
+                result.metricsPerSecond, result.calculationsPerSecond, result.p50, result.p99, result.rss);
+            fflush(stdout);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+/*  =========================================================================
+    tpower_replay - Replay of metrics recorded by the agent
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// @file   tpower_replay.cc
+/// @brief  Replay of the metric record (record/file of the configuration) for reproducible load tests
+///
+/// The topology is loaded from the snapshot saved next to the record, recorded batches are processed
+/// like the agent processes metrics read from the shared memory. By default the batches are replayed
+/// as fast as possible in virtual time, with --realtime they are replayed at the recorded pace.
+
+#include "src/clock.h"
+#include "src/metricrecord.h"
+#include "src/tpowerconfiguration.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options
+{
+    std::string record;
+    std::string topology; ///< snapshot, "<record>.topology" if empty
+    std::string settings; ///< configuration file, default settings if empty
+    bool        realtime = false;
+};
+
+struct Result
+{
+    uint64_t            batches     = 0;
+    uint64_t            metrics     = 0;
+    uint64_t            interesting = 0; ///< metrics feeding some unit
+    uint64_t            invalid     = 0; ///< values which weren't numbers
+    uint64_t            published   = 0;
+    std::vector<double> latencies;       ///< processing time of batches [us]
+};
+
+void s_usage(const char* name)
+{
+    printf("Usage: %s [options] RECORD\n", name);
+    printf("  -t, --topology FILE    topology snapshot (default RECORD.topology)\n");
+    printf("  -c, --config FILE      settings of the agent (default settings)\n");
+    printf("  -r, --realtime         replay at the recorded pace (default as fast as possible)\n");
+    printf("  -h, --help             this help\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+
+    static const struct option longOptions[] = {{"topology", required_argument, nullptr, 't'},
+        {"config", required_argument, nullptr, 'c'}, {"realtime", no_argument, nullptr, 'r'},
+        {"help", no_argument, nullptr, 'h'}, {nullptr, 0, nullptr, 0}};
+
+    int c;
+    while ((c = getopt_long(argc, argv, "t:c:rh", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 't':
+                options.topology = optarg;
+                break;
+            case 'c':
+                options.settings = optarg;
+                break;
+            case 'r':
+                options.realtime = true;
+                break;
+            case 'h':
+            default:
+                s_usage(argv[0]);
+                return (c == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc) {
+        s_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    options.record = argv[optind];
+    if (options.topology.empty()) {
+        options.topology = options.record + ".topology";
+    }
+
+    Result                  result;
+    TotalPowerConfiguration config([&result](const MetricInfo&) {
+        result.published++;
+        return true;
+    });
+
+    TPowerSettings settings;
+    if (!options.settings.empty() && !settings.load(options.settings)) {
+        fprintf(stderr, "can't load settings %s\n", options.settings.c_str());
+        return EXIT_FAILURE;
+    }
+    // the replay is neither recorded nor persisted
+    settings.recordFile.clear();
+    settings.stateFile.clear();
+    config.settings(settings);
+
+    PowerTopology    racks, dcs;
+    LocationTopology locations;
+    if (!loadTopologySnapshot(options.topology, racks, dcs, locations)) {
+        fprintf(stderr, "can't load topology snapshot %s\n", options.topology.c_str());
+        return EXIT_FAILURE;
+    }
+
+    MetricReplay replay;
+    if (!replay.open(options.record)) {
+        fprintf(stderr, "%s\n", replay.error().c_str());
+        return EXIT_FAILURE;
+    }
+
+    RecordedBatch batch;
+    bool          first  = true;
+    int64_t       offset = 0; ///< shift of recorded timestamps in the realtime mode [s]
+    uint64_t      polled = 0;
+    auto          start  = std::chrono::steady_clock::now();
+    while (replay.next(batch)) {
+        if (first) {
+            if (!options.realtime) {
+                Clock::setVirtual(batch.timestamp);
+            }
+            offset = int64_t(Clock::now()) - int64_t(batch.timestamp);
+            config.loadTopology(racks, dcs, locations);
+            polled = Clock::now();
+            first  = false;
+        }
+        if (options.realtime) {
+            int64_t wait = int64_t(batch.timestamp) + offset - int64_t(Clock::now());
+            if (wait > 0) {
+                std::this_thread::sleep_for(std::chrono::seconds(wait));
+            }
+        } else {
+            Clock::set(batch.timestamp);
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        config.beginBatch();
+        for (const auto& metric : batch.metrics) {
+            result.metrics++;
+            Quantity quantity = config.interestingQuantity(metric.element, metric.quantity);
+            if (quantity == Quantity::UNKNOWN) {
+                continue;
+            }
+            result.interesting++;
+            if (std::isnan(metric.value)) {
+                result.invalid++;
+                continue;
+            }
+            MetricSample sample = metric.sample();
+            sample.timestamp    = uint64_t(int64_t(sample.timestamp) + offset);
+            config.processMetric(sample, quantity);
+        }
+        config.endBatch();
+        config.setPollInterval();
+        // the agent polls when the timeout elapsed
+        if ((Clock::now() - polled) * 1000 >= uint64_t(config.getTimeout())) {
+            polled = Clock::now();
+            config.onPoll();
+        }
+        result.latencies.push_back(
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+        result.batches++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Clock::setSystem();
+
+    if (!replay.error().empty()) {
+        fprintf(stderr, "%s: %s (after %" PRIu64 " batches)\n", options.record.c_str(), replay.error().c_str(),
+            result.batches);
+    }
+
+    std::sort(result.latencies.begin(), result.latencies.end());
+    double p50 = 0, p99 = 0;
+    if (!result.latencies.empty()) {
+        p50 = result.latencies[result.latencies.size() / 2];
+        p99 = result.latencies[std::min(result.latencies.size() - 1, result.latencies.size() * 99 / 100)];
+    }
+    printf("batches:      %" PRIu64 "\n", result.batches);
+    printf("metrics:      %" PRIu64 " (interesting: %" PRIu64 ", invalid: %" PRIu64 ")\n", result.metrics,
+        result.interesting, result.invalid);
+    printf("published:    %" PRIu64 "\n", result.published);
+    printf("metrics/s:    %.0f\n", (seconds > 0) ? double(result.metrics) / seconds : 0.0);
+    printf("p50 [us]:     %.1f\n", p50);
+    printf("p99 [us]:     %.1f\n", p99);
+    return replay.error().empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
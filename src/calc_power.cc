@@ -17,13 +17,17 @@
  */
 
 #include "calc_power.h"
+#include "probes.h"
+#include "stagestats.h"
 #include <fty_common_asset_types.h>
 #include <fty_common_db.h>
 #include <fty_log.h>
+#include <exception>
 #include <functional>
 #include <set>
 #include <tntdb/result.h>
 #include <tntdb/row.h>
+#include <tntdb/statement.h>
 
 bool is_epdu(const device_info_t& device)
 {
@@ -99,11 +103,7 @@ bool is_powering_other_rack(const device_info_t& border_device,
 }
 
 
-/// An implementation of the algorithm.
-///
-/// Take a first "smart" device in every powerchain thatis closest to "main" If device is not smart, try to look at
-/// upper level. Repeat until chain ends or until all chains are processed
-static std::vector<std::string> compute_total_power_v2(const std::map<uint32_t, device_info_t>& devices_in_container,
+std::vector<std::string> compute_total_power_v2(const std::map<uint32_t, device_info_t>& devices_in_container,
     const std::set<std::pair<uint32_t, uint32_t>>& links, std::set<device_info_t> border_devices)
 {
     std::vector<std::string> dvc{};
@@ -136,6 +136,28 @@ static std::vector<std::string> compute_total_power_v2(const std::map<uint32_t,
 }
 
 
+/// db__select__start/done probes around a topology select, the done probe reports the result
+class SelectProbe
+{
+public:
+    SelectProbe(const char* what, int type, const db_reply<std::map<std::string, std::vector<std::string>>>& reply)
+        : _what(what)
+        , _type(type)
+        , _reply(reply)
+    {
+        TPOWER_PROBE2(db__select__start, _what, _type);
+    }
+    ~SelectProbe()
+    {
+        TPOWER_PROBE4(db__select__done, _what, _type, int(_reply.status), _reply.item.size());
+    }
+
+private:
+    const char*                                                      _what;
+    int                                                              _type;
+    const db_reply<std::map<std::string, std::vector<std::string>>>& _reply;
+};
+
 /// For every container returns a list of its power sources
 static db_reply<std::map<std::string, std::vector<std::string>>> select_devices_total_power_container(
     tntdb::Connection& conn, int8_t container_type_id)
@@ -145,9 +167,11 @@ static db_reply<std::map<std::string, std::vector<std::string>>> select_devices_
     // name of the container is mapped onto the vector of names of its power sources
     std::map<std::string, std::vector<std::string>>           item{};
     db_reply<std::map<std::string, std::vector<std::string>>> ret = db_reply_new(item);
+    SelectProbe                                               probe("containers", container_type_id, ret);
 
     // there is no need to do all in one select, so let's do it by steps
     // select all containers by type
+    StageStats::count(Counter::DB_QUERIES);
     auto allContainers = DBAssets::select_asset_elements_by_type(conn, uint16_t(container_type_id), "active");
 
     if (allContainers.status == 0) {
@@ -194,6 +218,7 @@ static db_reply<std::map<std::string, std::vector<std::string>>> select_devices_
             }
         };
 
+        StageStats::count(Counter::DB_QUERIES);
         auto rv = DBAssets::select_assets_by_container(conn, container.id, func, "active");
 
         // here would be placed names of devices to sum up
@@ -211,6 +236,7 @@ static db_reply<std::map<std::string, std::vector<std::string>>> select_devices_
             continue;
         }
 
+        StageStats::count(Counter::DB_QUERIES);
         auto links = DBAssets::select_links_by_container(conn, container.id, "active");
         if (links.status == 0) {
             log_warning("'%s': internal problems in links detecting", container.name.c_str());
@@ -287,3 +313,86 @@ db_reply<std::map<std::string, std::vector<std::string>>> select_devices_total_p
 {
     return select_devices_total_power_container(conn, persist::asset_type::RACK);
 }
+
+db_reply<std::map<std::string, std::vector<std::string>>> select_devices_total_power_rows(tntdb::Connection& conn)
+{
+    return select_devices_total_power_container(conn, persist::asset_type::ROW);
+}
+
+db_reply<std::map<std::string, std::vector<std::string>>> select_devices_total_power_rooms(tntdb::Connection& conn)
+{
+    return select_devices_total_power_container(conn, persist::asset_type::ROOM);
+}
+
+db_reply<std::map<std::string, std::vector<std::string>>> select_location_children(tntdb::Connection& conn)
+{
+    std::map<std::string, std::vector<std::string>>           item{};
+    db_reply<std::map<std::string, std::vector<std::string>>> ret = db_reply_new(item);
+    SelectProbe                                               probe("children", 0, ret);
+
+    // id -> name of all locations, (parent id, name) of all children
+    std::map<uint32_t, std::string>               names;
+    std::vector<std::pair<uint32_t, std::string>> children;
+    for (auto type : {persist::asset_type::DATACENTER, persist::asset_type::ROOM, persist::asset_type::ROW,
+             persist::asset_type::RACK}) {
+        StageStats::count(Counter::DB_QUERIES);
+        auto elements = DBAssets::select_asset_elements_by_type(conn, uint16_t(type), "active");
+        if (elements.status == 0) {
+            ret.status     = 0;
+            ret.msg        = elements.msg;
+            ret.errtype    = elements.errtype;
+            ret.errsubtype = elements.errsubtype;
+            log_error("some error appears, during selecting the locations");
+            return ret;
+        }
+        for (auto& element : elements.item) {
+            names.emplace(element.id, element.name);
+            if (type != persist::asset_type::DATACENTER) {
+                children.emplace_back(element.parent_id, element.name);
+            }
+        }
+    }
+
+    for (auto& child : children) {
+        auto parent = names.find(child.first);
+        if (parent != names.end()) {
+            ret.item[parent->second].push_back(child.second);
+        }
+    }
+    return ret;
+}
+
+db_reply<std::map<std::string, std::vector<std::string>>> select_groups_by_attributes(
+    tntdb::Connection& conn, const std::vector<std::string>& attributes)
+{
+    std::map<std::string, std::vector<std::string>>           item{};
+    db_reply<std::map<std::string, std::vector<std::string>>> ret = db_reply_new(item);
+    SelectProbe                                               probe("groups", 0, ret);
+
+    try {
+        tntdb::Statement st = conn.prepareCached(
+            " SELECT e.name AS name, a.value AS value"
+            " FROM t_bios_asset_ext_attributes AS a"
+            " INNER JOIN t_bios_asset_element AS e ON a.id_asset_element = e.id_asset_element"
+            " WHERE a.keytag = :keytag AND e.status = 'active'");
+
+        for (const auto& attribute : attributes) {
+            StageStats::count(Counter::DB_QUERIES);
+            tntdb::Result result = st.set("keytag", attribute).select();
+            for (const auto& row : result) {
+                std::string name, value;
+                row["name"].get(name);
+                row["value"].get(value);
+                if (!value.empty()) {
+                    ret.item[attribute + ":" + value].push_back(name);
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        ret.status  = 0;
+        ret.errtype = DB_ERR;
+        ret.msg     = e.what();
+        log_error("some error appears, during selecting the groups: %s", e.what());
+    }
+    return ret;
+}
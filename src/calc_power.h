@@ -25,7 +25,10 @@
 #include <czmq.h>
 #include <fty_common_db.h>
 #include <map>
+#include <set>
+#include <string>
 #include <tntdb/connect.h>
+#include <tuple>
 #include <vector>
 
 /// A type for storing basic information about powerlink.
@@ -72,6 +75,19 @@ bool is_ups(const device_info_t& device);
 // Functions that find power sources
 // ===========================================================================
 
+/// Power sources of one container.
+///
+/// Takes the first "smart" device in every powerchain that is closest to "main". If device is not smart, looks at
+/// the upper level. Repeats until the chain ends or until all chains are processed.
+///
+/// @param devices_in_container - devices of the container by asset element id
+/// @param links                - power links (src_id, dest_id) of the container
+/// @param border_devices       - devices powered from outside of the container or without a power source
+///
+/// @return names of devices to sum up
+std::vector<std::string> compute_total_power_v2(const std::map<uint32_t, device_info_t>& devices_in_container,
+    const std::set<std::pair<uint32_t, uint32_t>>& links, std::set<device_info_t> border_devices);
+
 /// For every rack analyses its power topology and for each rack returns a list of power devices that belong to "input
 /// power".
 ///
@@ -105,3 +121,48 @@ db_reply<std::map<std::string, std::vector<std::string>>> select_devices_total_p
 ///                             errsubtype is set,
 ///                             msg is set
 db_reply<std::map<std::string, std::vector<std::string>>> select_devices_total_power_dcs(tntdb::Connection& conn);
+
+/// For every row analyses its power topology and for each row returns a list of power devices that belong to "input
+/// power".
+///
+/// @param conn - a connection to the database
+///
+/// @return the same as select_devices_total_power_racks(), item is a map of row names onto its power sources
+db_reply<std::map<std::string, std::vector<std::string>>> select_devices_total_power_rows(tntdb::Connection& conn);
+
+/// For every room analyses its power topology and for each room returns a list of power devices that belong to "input
+/// power".
+///
+/// @param conn - a connection to the database
+///
+/// @return the same as select_devices_total_power_racks(), item is a map of room names onto its power sources
+db_reply<std::map<std::string, std::vector<std::string>>> select_devices_total_power_rooms(tntdb::Connection& conn);
+
+/// Location hierarchy of DCs, rooms, rows and racks.
+///
+/// @param conn - a connection to the database
+///
+/// @return in case of success: status = 1,
+///                             item is set to be a map of DC, room and row names
+///                                  onto names of its direct children (rooms, rows, racks)
+///         in case of fail:    status = 0,
+///                             errtype is set,
+///                             errsubtype is set,
+///                             msg is set
+db_reply<std::map<std::string, std::vector<std::string>>> select_location_children(tntdb::Connection& conn);
+
+/// Groups of assets given by their ext attributes.
+///
+/// An asset with the ext attribute 'tenant' = 'acme' is a member of the group 'tenant:acme'.
+///
+/// @param conn       - a connection to the database
+/// @param attributes - names of the ext attributes defining groups
+///
+/// @return in case of success: status = 1,
+///                             item is set to be a map of group names
+///                                  onto names of its members
+///         in case of fail:    status = 0,
+///                             errtype is set,
+///                             msg is set
+db_reply<std::map<std::string, std::vector<std::string>>> select_groups_by_attributes(
+    tntdb::Connection& conn, const std::vector<std::string>& attributes);
@@ -0,0 +1,88 @@
+/*  =========================================================================
+    clock - Time source of the agent
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#include "clock.h"
+#include <atomic>
+#include <ctime>
+
+namespace {
+
+/// virtual time [s], 0 if the system time is used
+std::atomic<uint64_t> s_virtual{0};
+
+/// time held by the thread and depth of hold() calls
+thread_local uint64_t s_held  = 0;
+thread_local int      s_depth = 0;
+
+} // namespace
+
+uint64_t Clock::now()
+{
+    uint64_t timestamp = s_virtual.load(std::memory_order_relaxed);
+    if (timestamp != 0) {
+        return timestamp;
+    }
+    return (s_depth > 0) ? s_held : uint64_t(::time(NULL));
+}
+
+void Clock::setVirtual(uint64_t timestamp)
+{
+    s_virtual = (timestamp != 0) ? timestamp : 1;
+}
+
+void Clock::setSystem()
+{
+    s_virtual = 0;
+}
+
+bool Clock::isVirtual()
+{
+    return s_virtual != 0;
+}
+
+void Clock::set(uint64_t timestamp)
+{
+    if (isVirtual()) {
+        setVirtual(timestamp);
+    }
+}
+
+void Clock::advance(uint64_t seconds)
+{
+    if (isVirtual()) {
+        s_virtual += seconds;
+    }
+}
+
+void Clock::hold()
+{
+    if (s_depth++ == 0) {
+        s_held = uint64_t(::time(NULL));
+    }
+}
+
+void Clock::release()
+{
+    if (s_depth > 0) {
+        s_depth--;
+    }
+}
@@ -0,0 +1,70 @@
+/*  =========================================================================
+    clock - Time source of the agent
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+/// @file   clock.h
+/// @brief  Time source of the agent (system, cached or virtual time)
+
+#pragma once
+
+#include <cstdint>
+
+/// Time source of all timing of the agent [s]
+///
+/// The system time is read unless the clock is cached (one read per batch of metrics)
+/// or virtual (tests and simulations move the time explicitly).
+class Clock
+{
+public:
+    /// current time [s]
+    static uint64_t now();
+
+    /// switch to virtual time starting at the timestamp, time moves only by set() or advance()
+    static void setVirtual(uint64_t timestamp);
+    /// switch back to the system time
+    static void setSystem();
+    /// true if the time is virtual
+    static bool isVirtual();
+    /// set virtual time [s]
+    static void set(uint64_t timestamp);
+    /// move virtual time forward [s]
+    static void advance(uint64_t seconds);
+
+    /// keep the time read by the first hold() until the last release() of the thread
+    static void hold();
+    static void release();
+
+    /// the time doesn't move during the scope (unless it's virtual)
+    class Cache
+    {
+    public:
+        Cache()
+        {
+            hold();
+        };
+        ~Cache()
+        {
+            release();
+        };
+        Cache(const Cache&) = delete;
+        Cache& operator=(const Cache&) = delete;
+    };
+};
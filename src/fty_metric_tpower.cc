@@ -22,22 +22,53 @@
 /// fty_metric_tpower - Evaluates some metrics and produces new power metrics
 
 #include "fty_metric_tpower_server.h"
+#include "stagestats.h"
+#include <atomic>
+#include <csignal>
 #include <fty_common_agents.h>
 #include <fty_common_mlm_guards.h>
 #include <fty_common_mlm_utils.h>
 #include <fty_log.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sstream>
+#include <thread>
 
 void usage()
 {
     puts(
-        "fty-metric-tpower [options]\n"
+        "fty-metric-tpower [options] [config_file]\n"
         "  -v|--verbose          verbose test output\n"
         "  -h|--help             print this information\n"
         "Environment variables for parameters are BIOS_LOG_LEVEL.\n"
         "Command line option takes precedence over variable.");
 }
 
+static std::atomic<bool> s_stopDump{false};
+
+/// SIGUSR1 dumps the stage statistics to the log
+///
+/// The signal is blocked in all threads and received here by sigwait(), so the dump
+/// isn't limited to async-signal-safe functions.
+static void s_dumpStats(sigset_t signals)
+{
+    while (true) {
+        int signal = 0;
+        if (sigwait(&signals, &signal) != 0) {
+            continue;
+        }
+        if (s_stopDump) {
+            break;
+        }
+        std::istringstream dump(StageStats::dump());
+        std::string        line;
+        log_info("stage statistics:");
+        while (std::getline(dump, line)) {
+            log_info("  %s", line.c_str());
+        }
+    }
+}
+
 int main(int argc, char* argv[])
 {
     int verbose = 0;
@@ -80,10 +111,18 @@ int main(int argc, char* argv[])
         usage();
         exit(1);
     }
+    const char* config_file = (optind < argc) ? argv[optind] : NULL;
 
     ManageFtyLog::setInstanceFtylog(AGENT_FTY_METRIC_TPOWER, FTY_COMMON_LOGGING_DEFAULT_CFG);
     log_info("fty_metric_tpower STARTED");
 
+    // threads of actors inherit the blocked signal
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    std::thread dumper(s_dumpStats, signals);
+
     zactor_t* tpower_server = zactor_new(fty_metric_tpower_server, const_cast<char*>(MLM_ENDPOINT));
 
     if (!tpower_server) {
@@ -94,6 +133,9 @@ int main(int argc, char* argv[])
     if (verbose) {
         ManageFtyLog::getInstanceFtylog()->setVeboseMode();
     }
+    if (config_file) {
+        zstr_sendx(tpower_server, "CONFIG", config_file, NULL);
+    }
     //  Accept and print any message back from server
     //  copy from src/malamute.c under MPL license
     while (!zsys_interrupted) {
@@ -110,6 +152,11 @@ int main(int argc, char* argv[])
     }
 
     zactor_destroy(&tpower_server);
+
+    s_stopDump = true;
+    pthread_kill(dumper.native_handle(), SIGUSR1);
+    dumper.join();
+
     log_info("fty_metric_tpower ENDED");
     return 0;
 }
@@ -23,12 +23,18 @@
 
 #include "fty_metric_tpower_server.h"
 #include "metricinfo.h"
+#include "probes.h"
+#include "reactor.h"
+#include "stagestats.h"
 #include "tpowerconfiguration.h"
+#include "tracer.h"
 #include "watchdog.h"
 #include <fty_common_mlm_guards.h>
 #include <fty_log.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
 #include <fty_shm.h>
-#include <mutex>
 #include <string>
 
 #define ANSI_COLOR_REDTHIN       "\x1b[0;31m"
@@ -43,8 +49,6 @@
 #define ANSI_COLOR_LIGHTMAGENTA  "\x1b[1;95m"
 #define ANSI_COLOR_RESET         "\x1b[0m"
 
-std::mutex mtx_tpowerConf;
-
 // agent's name ### DO NOT CHANGE! as other agents can rely on this name
 static const char* AGENT_NAME = "agent-tpower";
 
@@ -54,24 +58,69 @@ static const char* AGENT_NAME = "agent-tpower";
 
 bool send_metrics(const MetricInfo& M)
 {
-    log_debug(ANSI_COLOR_YELLOW "SHM metric sent: %s (value: %s [%s], timestamp: %s, ttl: %s)" ANSI_COLOR_RESET,
-        M.generateTopic().c_str(), std::to_string(M.getValue()).c_str(),
-        (M.getUnits().empty() ? "<no_unit>" : M.getUnits().c_str()), std::to_string(M.getTimestamp()).c_str(),
-        std::to_string(M.getTtl()).c_str());
-
-    int r = fty::shm::write_metric(
-        M.getElementName(), M.getSource(), std::to_string(M.getValue()), M.getUnits(), int(M.getTtl()));
+    log_debug(ANSI_COLOR_YELLOW "SHM metric sent: %s@%s (value: %f [%s], timestamp: %" PRIu64 ", ttl: %" PRIu64
+                                ")" ANSI_COLOR_RESET,
+        M.getSource().c_str(), M.getElementName().c_str(), M.getValue(),
+        (M.getUnits().empty() ? "<no_unit>" : M.getUnits().c_str()), M.getTimestamp(), M.getTtl());
+
+    std::string value = std::to_string(M.getValue());
+    TPOWER_PROBE3(publish__start, M.getElementName().c_str(), M.getSource().c_str(), value.c_str());
+    StageTimer timer(Stage::WRITE_METRIC, M.getElementName().c_str());
+    int        r = fty::shm::write_metric(M.getElementName(), M.getSource(), value, M.getUnits(), int(M.getTtl()));
+    timer.stop();
+    TPOWER_PROBE3(publish__done, M.getElementName().c_str(), M.getSource().c_str(), r);
     if (r == -1) {
-        log_error(
-            ANSI_COLOR_RED "shm::write_metric() failed (%s, r: %d)" ANSI_COLOR_RESET, M.generateTopic().c_str(), r);
+        log_error(ANSI_COLOR_RED "shm::write_metric() failed (%s@%s, r: %d)" ANSI_COLOR_RESET, M.getSource().c_str(),
+            M.getElementName().c_str(), r);
         return false;
     }
 
     return true;
 }
 
+// alert is alive for 3 periodic republishings of the total
+static const uint32_t ALERT_TTL = 3 * TPOWER_MEASUREMENT_REPEAT_AFTER;
+
+static bool s_sendAlert(mlm_client_t* producer, const ThresholdAlert& alert)
+{
+    bool        high     = (alert.limit == ThresholdState::HIGH);
+    std::string rule     = std::string(quantity::name(alert.quantity)) + (high ? ".high@" : ".low@") + alert.unit;
+    const char* severity = high ? "CRITICAL" : "WARNING";
+    const char* state    = alert.active ? "ACTIVE" : "RESOLVED";
+
+    char description[256];
+    snprintf(description, sizeof(description), "%s of %s is %.1f W (%s threshold %.1f W)",
+        quantity::name(alert.quantity), alert.unit.c_str(), alert.value, high ? "high" : "low", alert.threshold);
+
+    zmsg_t* msg = fty_proto_encode_alert(NULL, alert.timestamp, ALERT_TTL, rule.c_str(), alert.unit.c_str(), state,
+        severity, description, NULL);
+    std::string subject = rule + "/" + severity + "@" + alert.unit;
+    if (mlm_client_send(producer, subject.c_str(), &msg) != 0) {
+        log_error(ANSI_COLOR_RED "cannot send alert %s (%s)" ANSI_COLOR_RESET, subject.c_str(), state);
+        zmsg_destroy(&msg);
+        return false;
+    }
+    log_debug(ANSI_COLOR_YELLOW "alert sent: %s (%s)" ANSI_COLOR_RESET, subject.c_str(), state);
+    return true;
+}
+
+/// outcome of a metric reported by the metric__done probe
+enum
+{
+    METRIC_PROCESSED = 0,
+    METRIC_IGNORED   = 1, ///< not interesting for any unit
+    METRIC_INVALID   = 2, ///< value is not a number
+};
+
 static void s_processMetrics(TotalPowerConfiguration& config, fty::shm::shmMetrics& metrics)
 {
+    TPOWER_PROBE1(batch__start, metrics.size());
+
+    // units shared by more metrics are recalculated once
+    config.beginBatch();
+
+    uint64_t processed = 0;
+
     for (auto& metric : metrics) {
         const char* asset_name = fty_proto_name(metric);
         const char* type       = fty_proto_type(metric);
@@ -79,72 +128,185 @@ static void s_processMetrics(TotalPowerConfiguration& config, fty::shm::shmMetri
         const char* unit       = fty_proto_unit(metric);
         uint64_t    timestamp  = fty_proto_time(metric);
         uint32_t    ttl        = fty_proto_ttl(metric); // time-to-live
+        TPOWER_PROBE3(metric__start, asset_name, type, value_s);
+
+        if (config.recording()) {
+            // the whole load is recorded, invalid values as NAN
+            char*  end      = NULL;
+            double recorded = strtod(value_s, &end);
+            if (end == value_s || *end != '\0') {
+                recorded = NAN;
+            }
+            config.record(MetricSample(asset_name, type, unit ? unit : "", recorded, timestamp, ttl));
+        }
+        Quantity quantity = config.interestingQuantity(asset_name, type);
+        if (quantity == Quantity::UNKNOWN) {
+            // most of metrics in shm don't feed any rack or DC
+            TPOWER_PROBE3(metric__done, asset_name, type, METRIC_IGNORED);
+            continue;
+        }
 
-        std::string topic = type + std::string("@") + asset_name;
-
-        log_trace("process metric %s (value: %s, unit: %s)", topic.c_str(), value_s, unit);
+        log_trace("process metric %s@%s (value: %s, unit: %s)", type, asset_name, value_s, unit);
 
-        char* end    = NULL;
-        errno        = 0;
-        double value = strtod(value_s, &end);
+        StageTimer parse(Stage::PARSE);
+        char*      end   = NULL;
+        errno            = 0;
+        double     value = strtod(value_s, &end);
+        parse.stop();
         if (errno == ERANGE || end == value_s || *end != '\0') {
-            log_error("cannot convert %s value '%s' to double, ignored...", topic.c_str(), value_s);
+            log_error("cannot convert %s@%s value '%s' to double, ignored...", type, asset_name, value_s);
             fty_proto_print(metric);
+            TPOWER_PROBE3(metric__done, asset_name, type, METRIC_INVALID);
             continue;
         }
 
-        MetricInfo m(asset_name, type, unit, value, timestamp, ttl);
-        mtx_tpowerConf.lock();
-        config.processMetric(m, topic);
-        mtx_tpowerConf.unlock();
+        MetricSample sample(asset_name, type, unit ? unit : "", value, timestamp, ttl);
+        config.processMetric(sample, quantity); // the filter isn't probed again
+        processed++;
+        TPOWER_PROBE3(metric__done, asset_name, type, METRIC_PROCESSED);
 
-        log_trace("process %s metric done", topic.c_str());
+        log_trace("process %s@%s metric done", type, asset_name);
     }
 
-    mtx_tpowerConf.lock();
+    TraceSpan publish("publish", "main");
+    config.endBatch();
     config.setPollInterval();
-    mtx_tpowerConf.unlock();
+    publish.stop();
+
+    StageStats::count(Counter::METRICS_READ, metrics.size());
+    StageStats::count(Counter::METRICS_PROCESSED, processed);
+    TPOWER_PROBE2(batch__done, metrics.size(), processed);
 }
 
-// simple poller actor
-// regularly read and process 'power' metrics coming from shm
-static void fty_metric_tpower_metric_pull(zsock_t* pipe, void* args)
+/// reply to STATS request: "OK", then pairs of name and value
+static void s_replyStats(
+    mlm_client_t* client, TotalPowerConfiguration& config, const Reactor& reactor, const Watchdog& watchdog)
 {
-    assert(pipe);
-    assert(args);
+    PublishStats stats = config.publishStats();
 
-    zpoller_t* poller = zpoller_new(pipe, NULL);
-    zsock_signal(pipe, 0);
+    zmsg_t* reply = zmsg_new();
+    zmsg_addstr(reply, "OK");
+    for (const auto& it : StageStats::report()) {
+        zmsg_addstr(reply, it.first.c_str());
+        zmsg_addstr(reply, it.second.c_str());
+    }
+    const std::pair<const char*, uint64_t> counters[] = {{"published", stats.published},
+        {"deadband_suppressed", stats.deadbandSuppressed}, {"interval_suppressed", stats.intervalSuppressed},
+        {"calculations", stats.calculations}, {"wakeups", reactor.wakeups()}};
+    for (const auto& it : counters) {
+        zmsg_addstr(reply, it.first);
+        zmsg_addstr(reply, std::to_string(it.second).c_str());
+    }
+    uint64_t now = Watchdog::now();
+    for (size_t i = 0; i < HEARTBEAT_COUNT; ++i) {
+        std::string prefix = std::string("liveness.") + Watchdog::name(Heartbeat(i));
+        zmsg_addstr(reply, (prefix + ".lag_s").c_str());
+        zmsg_addstr(reply, std::to_string(watchdog.lag(Heartbeat(i), now)).c_str());
+        zmsg_addstr(reply, (prefix + ".limit_s").c_str());
+        zmsg_addstr(reply, std::to_string(watchdog.limit(Heartbeat(i))).c_str());
+    }
+    if (mlm_client_sendto(client, mlm_client_sender(client), "STATS", NULL, 1000, &reply) != 0) {
+        log_error("cannot send STATS reply to %s", mlm_client_sender(client));
+        zmsg_destroy(&reply);
+    }
+}
 
-    TotalPowerConfiguration* totalpower_conf = reinterpret_cast<TotalPowerConfiguration*>(args);
-    uint64_t                 timeout         = uint64_t(fty_get_polling_interval() * 1000);
+/// reply to the sender of the request: "OK" or "ERROR" and the reason or the result
+static void s_reply(mlm_client_t* client, bool ok, const char* detail)
+{
+    zmsg_t* reply = zmsg_new();
+    zmsg_addstr(reply, ok ? "OK" : "ERROR");
+    if (detail) {
+        zmsg_addstr(reply, detail);
+    }
+    if (mlm_client_sendto(client, mlm_client_sender(client), mlm_client_subject(client), NULL, 1000, &reply) != 0) {
+        log_error("cannot send reply to %s", mlm_client_sender(client));
+        zmsg_destroy(&reply);
+    }
+}
 
-    while (!zsys_interrupted) {
-        void* which = zpoller_wait(poller, int(timeout));
-        if (which == NULL) {
-            if (zpoller_terminated(poller) || zsys_interrupted) {
-                break;
-            }
-            if (zpoller_expired(poller)) {
-                const std::string    assetFilter(".*");
-                // No current, voltage and VA for location
-                const std::string    typeFilter("realpower\\.(default|((output|input)\\.L(1|2|3)))"
-                                                "|current\\.(output|input)\\.L(1|2|3)"
-                                                "|voltage\\.(output|input)\\.L(1|2|3)-N");
-                fty::shm::shmMetrics result;
-                fty::shm::read_metrics(assetFilter.c_str(), typeFilter.c_str(), result);
-
-                log_debug(ANSI_COLOR_BLUE "Polling: read metrics (assets: %s, types: %s, size: %d)" ANSI_COLOR_RESET,
-                    assetFilter.c_str(), typeFilter.c_str(), result.size());
-
-                s_processMetrics(*totalpower_conf, result);
-            }
+/// TRACE request: START (recorded spans are dropped), STOP or DUMP (to the trace file of the settings)
+static void s_processTrace(mlm_client_t* client, zmsg_t* message, const std::string& traceFile)
+{
+    ZstrGuard action(zmsg_popstr(message));
+    if (action && streq(action, "START")) {
+        Tracer::clear();
+        Tracer::enable(true);
+        log_info("tracing started");
+        s_reply(client, true, NULL);
+    } else if (action && streq(action, "STOP")) {
+        Tracer::enable(false);
+        log_info("tracing stopped");
+        s_reply(client, true, NULL);
+    } else if (action && streq(action, "DUMP")) {
+        if (traceFile.empty()) {
+            log_error("cannot write trace, trace/file isn't configured");
+            s_reply(client, false, "NO_TRACE_FILE");
+            return;
         }
-        timeout = uint64_t(fty_get_polling_interval() * 1000);
+        if (!Tracer::write(traceFile)) {
+            log_error("cannot write trace to '%s'", traceFile.c_str());
+            s_reply(client, false, "CANNOT_WRITE");
+            return;
+        }
+        log_info("trace written to '%s'", traceFile.c_str());
+        s_reply(client, true, traceFile.c_str());
+    } else {
+        s_reply(client, false, "UNKNOWN_ACTION");
+    }
+}
+
+/// mailbox requests of other agents
+static void s_processMailbox(mlm_client_t* client, zmsg_t* message, TotalPowerConfiguration& config,
+    const Reactor& reactor, const Watchdog& watchdog, const std::string& traceFile)
+{
+    TraceSpan span("mailbox", "main");
+    ZstrGuard command(zmsg_popstr(message));
+    if (command && streq(command, "STATS")) {
+        s_replyStats(client, config, reactor, watchdog);
+        return;
+    }
+    if (command && streq(command, "TRACE")) {
+        s_processTrace(client, message, traceFile);
+        return;
     }
+    log_warning("unknown mailbox request '%s' from %s", command ? command.get() : "", mlm_client_sender(client));
+    s_reply(client, false, "UNKNOWN_REQUEST");
+}
+
+/// read 'power' metrics from shm and process them
+void pull_metrics(TotalPowerConfiguration& config)
+{
+    TraceSpan            cycle("cycle", "main");
+    const std::string    assetFilter(".*");
+    // No current, voltage and VA for location
+    const std::string    typeFilter("realpower\\.(default|((output|input)\\.L(1|2|3)))"
+                                    "|current\\.(output|input)\\.L(1|2|3)"
+                                    "|voltage\\.(output|input)\\.L(1|2|3)-N"
+                                    "|power\\.input\\.L(1|2|3)");
+    fty::shm::shmMetrics result;
+    StageTimer           timer(Stage::SHM_READ);
+    fty::shm::read_metrics(assetFilter.c_str(), typeFilter.c_str(), result);
+    timer.stop();
+
+    log_debug(ANSI_COLOR_BLUE "Polling: read metrics (assets: %s, types: %s, size: %d)" ANSI_COLOR_RESET,
+        assetFilter.c_str(), typeFilter.c_str(), result.size());
+
+    s_processMetrics(config, result);
+}
+
+/// socket is readable by the reactor, ZMQ_FD doesn't say which events are pending
+static bool s_readable(zsock_t* socket)
+{
+    return (zsock_events(socket) & ZMQ_POLLIN) != 0;
 }
 
 // main actor
+//
+// One thread reacts on messages (pipe, malamute) and timers: the read of metrics
+// from shm, the periodic poll of the configuration (advertisement deadlines,
+// reconfiguration) and the check of the malamute connection. It sleeps until
+// the nearest of them. Completed stages beat the watchdog running in its own thread.
 void fty_metric_tpower_server(zsock_t* pipe, void* args)
 {
     assert(pipe);
@@ -152,12 +314,16 @@ void fty_metric_tpower_server(zsock_t* pipe, void* args)
 
     const char* endpoint = static_cast<const char*>(args);
 
-    // Setup the watchdog
+    // Setup the watchdog, it's stopped by the destructor
     Watchdog watchdog;
     watchdog.start();
 
     // Signal need to be send as it is required by "actor_new"
     zsock_signal(pipe, 0);
+    Tracer::threadName("main actor");
+
+    // written by TRACE DUMP request
+    std::string traceFile = TPowerSettings().traceFile;
 
     MlmClientGuard client(mlm_client_new());
     if (!client) {
@@ -177,103 +343,178 @@ void fty_metric_tpower_server(zsock_t* pipe, void* args)
         return;
     }
 
-    ZpollerGuard poller(zpoller_new(pipe, mlm_client_msgpipe(client), NULL));
-
     // Such trick with function is used, because tpower_configuration
     // wants itself to control "advertise time".
     // But We want to separate logic from messaging -> use function as parameter
-    std::function<bool(const MetricInfo&)> tpower_conf_callback = [](const MetricInfo& M) -> bool {
-        return send_metrics(M);
+    std::function<bool(const MetricInfo&)> tpower_conf_callback = [&watchdog](const MetricInfo& M) -> bool {
+        if (!send_metrics(M)) {
+            return false;
+        }
+        watchdog.beat(Heartbeat::PUBLISH);
+        return true;
     };
 
     // initial set up
     TotalPowerConfiguration tpower_conf(tpower_conf_callback);
-    tpower_conf.configure();
 
-    // run 'power' metrics poller actor
-    zactor_t* tpower_metrics_pull = zactor_new(fty_metric_tpower_metric_pull, &tpower_conf);
+    // alerts have their own producer, the main client is a consumer of assets
+    MlmClientGuard alerts(mlm_client_new());
+    std::string    alertsName = std::string(AGENT_NAME) + "-alerts";
+    if (!alerts || (mlm_client_connect(alerts, endpoint, 1000, alertsName.c_str()) < 0) ||
+        (mlm_client_set_producer(alerts, FTY_PROTO_STREAM_ALERTS_SYS) < 0)) {
+        log_error("%s: can't set producer on stream '%s', alerts are disabled", alertsName.c_str(),
+            FTY_PROTO_STREAM_ALERTS_SYS);
+    } else {
+        mlm_client_t* producer = alerts;
+        tpower_conf.alertFunction([producer](const ThresholdAlert& alert) -> bool {
+            return s_sendAlert(producer, alert);
+        });
+    }
 
-    uint64_t last = uint64_t(zclock_mono());
-    while (!zsys_interrupted) {
-        void* which = zpoller_wait(poller, int(tpower_conf.getTimeout()));
+    tpower_conf.configure();
 
-        uint64_t now = uint64_t(zclock_mono());
-        if ((now - last) >= static_cast<uint64_t>(tpower_conf.getTimeout())) {
-            last = now;
-            log_debug("Periodic polling");
-            mtx_tpowerConf.lock();
-            tpower_conf.onPoll();
-            mtx_tpowerConf.unlock();
-        }
+    Reactor reactor;
+    if (!reactor.valid()) {
+        zstr_send(pipe, "$TERM");
+        return;
+    }
 
-        if (zpoller_expired(poller)) {
-            continue;
-        }
-        if (zpoller_terminated(poller)) {
-            log_info("poller was terminated");
-            break;
+    // periodic poll of the configuration, due getTimeout() [ms] after the last one;
+    // the timeout changes with the configuration, the timer follows it after each event
+    uint64_t lastPoll     = Reactor::now();
+    int      pollTimer    = -1;
+    auto     schedulePoll = [&]() {
+        reactor.armAt(pollTimer, lastPoll + uint64_t(std::max<int64_t>(tpower_conf.getTimeout(), 0)));
+    };
+    pollTimer = reactor.addTimer([&]() {
+        lastPoll = Reactor::now();
+        log_debug("Periodic polling");
+        TraceSpan span("poll", "main");
+        tpower_conf.onPoll();
+        span.stop();
+        watchdog.beat(Heartbeat::CALCULATION);
+        schedulePoll();
+    });
+
+    int pullTimer = reactor.addTimer([&]() {
+        pull_metrics(tpower_conf);
+        watchdog.beat(Heartbeat::SHM_POLL);
+        reactor.armIn(pullTimer, uint64_t(fty_get_polling_interval() * 1000));
+        schedulePoll();
+    });
+
+    // quiet asset stream is fine as long as the client is connected
+    int connectedTimer = reactor.addTimer([&]() {
+        if (mlm_client_connected(client)) {
+            watchdog.beat(Heartbeat::MLM);
+        } else {
+            log_warning("%s: not connected to malamute for %" PRIu64 " s", AGENT_NAME, watchdog.lag(Heartbeat::MLM));
         }
+        reactor.armIn(connectedTimer, Watchdog::INTERVAL);
+    });
+
+    if ((pollTimer < 0) || (pullTimer < 0) || (connectedTimer < 0)) {
+        zstr_send(pipe, "$TERM");
+        return;
+    }
 
-        if (which == pipe) {
+    // commands of the parent
+    reactor.addSocket(
+        zsock_fd(pipe),
+        [pipe]() {
+            return s_readable(pipe);
+        },
+        [&]() {
             ZmsgGuard msg(zmsg_recv(pipe));
             ZstrGuard cmd(zmsg_popstr(msg));
+            if (!cmd) {
+                log_info("pipe was interrupted");
+                reactor.stop();
+                return;
+            }
             log_trace("Got command '%s'", cmd.get());
 
             if (streq(cmd, "$TERM")) {
                 log_info("Terminate...");
-                break;
+                reactor.stop();
+            } else if (streq(cmd, "CONFIG")) {
+                ZstrGuard      path(zmsg_popstr(msg));
+                TPowerSettings settings;
+                if (path && settings.load(path.get())) {
+                    traceFile = settings.traceFile;
+                    watchdog.limits(settings.watchdogLimits);
+                    tpower_conf.settings(settings);
+                    schedulePoll();
+                }
             } else {
                 log_info("unhandled command %s", cmd.get());
             }
-            continue;
-        }
+        });
+
+    // This agent is a reactive agent, it reacts only on messages
+    // and doesn't do anything if there is no messages
+    zsock_t* msgpipe = mlm_client_msgpipe(client);
+    reactor.addSocket(
+        zsock_fd(msgpipe),
+        [msgpipe]() {
+            return s_readable(msgpipe);
+        },
+        [&]() {
+            zmsg_t* zmessage = mlm_client_recv(client);
+            if (zmessage == NULL) {
+                return;
+            }
+            // As long as we are receiving messages from malamute, the client
+            // is fine
+            watchdog.beat(Heartbeat::MLM);
 
-        // This agent is a reactive agent, it reacts only on messages
-        // and doesn't do anything if there is no messages
-        zmsg_t* zmessage = mlm_client_recv(client);
-        if (zmessage == NULL) {
-            continue;
-        }
+            std::string topic = mlm_client_subject(client);
+            log_trace("Got message '%s'", topic.c_str());
 
-        std::string topic = mlm_client_subject(client);
-        log_trace("Got message '%s'", topic.c_str());
-
-        // What is going on???
-        //
-        // Listen on metrics +
-        // Listen on assets
-        //
-        // Produce metrics +
-        //
-        // Current iplementation: read topology from DB
-        // TODO: move it to asset agent and receive this info
-        // as message
-
-        if (fty_proto_is(zmessage)) {
-            fty_proto_t* bmessage = fty_proto_decode(&zmessage);
-            if (!bmessage) {
-                log_error("cannot decode fty_proto message, ignore it");
+            if (streq(mlm_client_command(client), "MAILBOX DELIVER")) {
+                s_processMailbox(client, zmessage, tpower_conf, reactor, watchdog, traceFile);
                 zmsg_destroy(&zmessage);
-                continue;
+                return;
             }
-            // As long as we are receiving metrics from malamute, everything
-            // is fine
-            watchdog.tick();
-            if (fty_proto_id(bmessage) == FTY_PROTO_ASSET) {
-                mtx_tpowerConf.lock();
-                tpower_conf.processAsset(bmessage);
-                mtx_tpowerConf.unlock();
+
+            // What is going on???
+            //
+            // Listen on metrics +
+            // Listen on assets
+            //
+            // Produce metrics +
+            //
+            // Current iplementation: read topology from DB
+            // TODO: move it to asset agent and receive this info
+            // as message
+
+            if (fty_proto_is(zmessage)) {
+                fty_proto_t* bmessage = fty_proto_decode(&zmessage);
+                if (!bmessage) {
+                    log_error("cannot decode fty_proto message, ignore it");
+                    zmsg_destroy(&zmessage);
+                    return;
+                }
+                if (fty_proto_id(bmessage) == FTY_PROTO_ASSET) {
+                    TraceSpan span("asset", "main", fty_proto_name(bmessage));
+                    tpower_conf.processAsset(bmessage);
+                    schedulePoll();
+                } else {
+                    log_error("it is not an asset message, ignore it");
+                }
+                fty_proto_destroy(&bmessage);
             } else {
-                log_error("it is not an asset message, ignore it");
+                log_error("not a fty_proto message");
             }
-            fty_proto_destroy(&bmessage);
-        } else {
-            log_error("not a fty_proto message");
-        }
 
-        zmsg_destroy(&zmessage);
-    }
+            zmsg_destroy(&zmessage);
+        });
+
+    reactor.armIn(pullTimer, uint64_t(fty_get_polling_interval() * 1000));
+    reactor.armIn(connectedTimer, Watchdog::INTERVAL);
+    schedulePoll();
+    reactor.run();
 
-    // TODO:  save info to persistence before I die
-    zactor_destroy(&tpower_metrics_pull);
+    // energy counters survive the restart
+    tpower_conf.saveState();
 }
@@ -23,7 +23,10 @@
 #include <czmq.h>
 
 class MetricInfo;
+class TotalPowerConfiguration;
 
 //  Metric tpower server actor
 void fty_metric_tpower_server(zsock_t* pipe, void* args);
 bool send_metrics(const MetricInfo& M);
+//  Read the metrics of power devices from shm and process them
+void pull_metrics(TotalPowerConfiguration& config);
@@ -0,0 +1,149 @@
+/*  =========================================================================
+    measurement - Compact record of one measurement
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// @file   measurement.h
+/// @brief  Compact record of one measurement, used for internal storage
+
+#pragma once
+
+#include "metricinfo.h"
+#include "nameregistry.h"
+#include "quantity.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+
+/// Compact measurement
+///
+/// Names are interned (see NameRegistry), timestamp is relative to
+/// TIMESTAMP_BASE. MetricInfo is built only when the measurement leaves
+/// the agent.
+struct Measurement
+{
+    /// base of the relative timestamps (2020-01-01 00:00:00 UTC)
+    static constexpr uint64_t TIMESTAMP_BASE = 1577836800;
+
+    /// value, NAN if unknown
+    double value = std::nan("");
+    /// timestamp relative to TIMESTAMP_BASE [s]
+    uint32_t timestamp = 0;
+    /// element name ID in NameRegistry::elements(), NameRegistry::NONE if the measurement is empty
+    uint32_t element = NameRegistry::NONE;
+    /// units ID in NameRegistry::units()
+    uint16_t units = NameRegistry::NONE;
+    /// time to live [s]
+    uint16_t ttl = 0;
+    /// measured quantity
+    Quantity quantity = Quantity::UNKNOWN;
+
+    Measurement() = default;
+
+    Measurement(Quantity q, uint32_t elementId, uint16_t unitsId, double v, uint64_t ts, uint64_t timeToLive)
+        : value(v)
+        , timestamp(relative(ts))
+        , element(elementId)
+        , units(unitsId)
+        , ttl(uint16_t(std::min<uint64_t>(timeToLive, UINT16_MAX)))
+        , quantity(q){};
+
+    /// build the record from the metric, quantity must be already parsed
+    ///
+    /// Names are interned, known names don't allocate.
+    static Measurement fromMetric(Quantity q, std::string_view element, std::string_view units, double value,
+        uint64_t timestamp, uint64_t ttl)
+    {
+        uint32_t unitsId = NameRegistry::units().intern(units);
+        return Measurement(q, NameRegistry::elements().intern(element),
+            uint16_t(unitsId <= UINT16_MAX ? unitsId : NameRegistry::NONE), value, timestamp, ttl);
+    };
+    static Measurement fromMetricInfo(Quantity q, const MetricInfo& M)
+    {
+        return fromMetric(q, M.getElementName(), M.getUnits(), M.getValue(), M.getTimestamp(), M.getTtl());
+    };
+
+    /// build the metric for publishing
+    MetricInfo toMetricInfo() const
+    {
+        return MetricInfo(NameRegistry::elements().name(element), quantity::name(quantity),
+            NameRegistry::units().name(units), value, getTimestamp(), ttl);
+    };
+
+    /// returns true if nothing was measured
+    bool isUnknown() const
+    {
+        return element == NameRegistry::NONE;
+    };
+
+    /// absolute timestamp [s]
+    uint64_t getTimestamp() const
+    {
+        return TIMESTAMP_BASE + timestamp;
+    };
+
+    /// set absolute timestamp [s]
+    void setTimestamp(uint64_t ts)
+    {
+        timestamp = relative(ts);
+    };
+
+    /// returns true if the measurement is older than its time to live
+    bool expired(uint64_t now) const
+    {
+        return (now - getTimestamp()) > ttl;
+    };
+
+private:
+    static uint32_t relative(uint64_t ts)
+    {
+        // older timestamps are expired anyway
+        return (ts > TIMESTAMP_BASE) ? uint32_t(std::min<uint64_t>(ts - TIMESTAMP_BASE, UINT32_MAX)) : 0;
+    };
+};
+
+static_assert(sizeof(Measurement) <= 32, "Measurement should stay compact");
+
+/// Metric as received, strings are not owned
+///
+/// Used on the ingest path, so no strings are built for known assets.
+struct MetricSample
+{
+    std::string_view element;  ///< 'epdu-42'
+    std::string_view quantity; ///< 'realpower.input.L3'
+    std::string_view units;    ///< 'W'
+    double           value     = 0;
+    uint64_t         timestamp = 0; ///< [s]
+    uint64_t         ttl       = 0; ///< time to live [s]
+
+    MetricSample() = default;
+
+    MetricSample(std::string_view e, std::string_view q, std::string_view u, double v, uint64_t ts, uint64_t t)
+        : element(e)
+        , quantity(q)
+        , units(u)
+        , value(v)
+        , timestamp(ts)
+        , ttl(t){};
+
+    /// view of the metric, valid as long as the metric is
+    explicit MetricSample(const MetricInfo& M)
+        : MetricSample(M.getElementName(), M.getSource(), M.getUnits(), M.getValue(), M.getTimestamp(), M.getTtl()){};
+};
@@ -0,0 +1,103 @@
+/*  =========================================================================
+    metricfilter - Quick reject of metrics not used by any rack or DC
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#include "metricfilter.h"
+#include "nameregistry.h"
+#include <functional>
+
+static size_t s_hash(std::string_view element)
+{
+    return std::hash<std::string_view>{}(element);
+}
+
+/// all bits of the hash folded to the tag (size_t has 32 bits on some targets)
+static uint32_t s_tag(size_t hash)
+{
+    return uint32_t(hash ^ (hash >> (4 * sizeof(hash)))) | 1; // never 0
+}
+
+MetricFilter::MetricFilter()
+    : _slots(64)
+{
+}
+
+void MetricFilter::clear()
+{
+    _slots.assign(64, Entry());
+    _size = 0;
+}
+
+size_t MetricFilter::slot(std::string_view element, size_t hash) const
+{
+    const auto& names = NameRegistry::elements();
+    uint32_t    tag   = s_tag(hash);
+    size_t      mask  = _slots.size() - 1;
+    size_t      i     = hash & mask;
+    while (_slots[i].element != NameRegistry::NONE) {
+        if ((_slots[i].tag == tag) && (names.name(_slots[i].element) == element)) {
+            break;
+        }
+        i = (i + 1) & mask; // linear probing
+    }
+    return i;
+}
+
+void MetricFilter::add(std::string_view element, Quantity quantity)
+{
+    if (element.empty() || (quantity == Quantity::UNKNOWN)) {
+        return;
+    }
+    size_t hash  = s_hash(element);
+    Entry& entry = _slots[slot(element, hash)];
+    if (entry.element == NameRegistry::NONE) {
+        entry.element = NameRegistry::elements().intern(element);
+        entry.tag     = s_tag(hash);
+        _size++;
+    }
+    entry.mask |= quantity::mask(quantity);
+
+    if (_size * 2 > _slots.size()) {
+        // keep load factor under 1/2
+        grow();
+    }
+}
+
+bool MetricFilter::contains(std::string_view element, Quantity quantity) const
+{
+    uint32_t quantityMask = quantity::mask(quantity);
+    if (quantityMask == 0) {
+        return false;
+    }
+    const Entry& entry = _slots[slot(element, s_hash(element))];
+    return (entry.mask & quantityMask) != 0;
+}
+
+void MetricFilter::grow()
+{
+    const auto&        names = NameRegistry::elements();
+    std::vector<Entry> old(_slots.size() * 2);
+    old.swap(_slots);
+    for (const auto& entry : old) {
+        if (entry.element != NameRegistry::NONE) {
+            _slots[slot(names.name(entry.element), s_hash(names.name(entry.element)))] = entry;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/*  =========================================================================
+    metricfilter - Quick reject of metrics not used by any rack or DC
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// @file   metricfilter.h
+/// @brief  Quick reject of metrics not used by any rack or DC
+
+#pragma once
+
+#include "quantity.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/// Set of interesting (asset, quantity) pairs
+///
+/// Open addressing hash table: asset -> mask of quantities. Assets are
+/// stored as NameRegistry::elements() IDs with a hash tag, so a miss is
+/// usually decided without comparing strings.
+class MetricFilter
+{
+public:
+    MetricFilter();
+
+    /// remove all entries
+    void clear();
+
+    /// add interesting quantity of the asset
+    void add(std::string_view element, Quantity quantity);
+
+    /// returns true if the quantity of the asset is interesting
+    bool contains(std::string_view element, Quantity quantity) const;
+    bool contains(std::string_view element, std::string_view quantity) const
+    {
+        return contains(element, quantity::fromString(quantity));
+    };
+
+    /// number of assets
+    size_t size() const
+    {
+        return _size;
+    };
+
+private:
+    struct Entry
+    {
+        uint32_t element = 0; ///< NameRegistry::NONE for empty slots
+        uint32_t tag     = 0; ///< folded bits of the hash
+        uint32_t mask    = 0; ///< quantity::mask() of interesting quantities
+    };
+
+    /// hash table (size is power of 2)
+    std::vector<Entry> _slots;
+    /// number of used slots
+    size_t _size = 0;
+
+    /// slot of the asset or the empty slot where it belongs
+    size_t slot(std::string_view element, size_t hash) const;
+    /// double the table and rehash
+    void grow();
+};
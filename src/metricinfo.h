@@ -20,7 +20,7 @@
 */
 #pragma once
 
-#include <ctime>
+#include "clock.h"
 #include <string>
 
 /// @file   metricinfo.h
@@ -45,17 +45,17 @@ public:
         , _timestamp(timestamp)
         , _ttl(ttl){};
 
-    std::string getElementName(void) const
+    const std::string& getElementName(void) const
     {
         return _element_name;
     };
 
-    std::string getSource(void) const
+    const std::string& getSource(void) const
     {
         return _source;
     };
 
-    std::string getUnits(void) const
+    const std::string& getUnits(void) const
     {
         return _units;
     };
@@ -95,15 +95,27 @@ public:
 
     void setTime(void)
     {
-        _timestamp = uint64_t(std::time(NULL));
+        _timestamp = Clock::now();
     }; // timetamp = now
 
+    void setValue(double value)
+    {
+        _value = value;
+    };
+
+    void setTimestamp(uint64_t timestamp)
+    {
+        _timestamp = timestamp;
+    };
+
+    void setTtl(uint64_t ttl)
+    {
+        _ttl = ttl;
+    };
+
     friend inline bool operator==(const MetricInfo& lhs, const MetricInfo& rhs);
     friend inline bool operator!=(const MetricInfo& lhs, const MetricInfo& rhs);
 
-    // This class is very close to metric info, so let it use fields directly
-    friend class MetricList;
-
 private:
     std::string _element_name; // 'epdu-42'
     std::string _source;       // 'realpower.input.L3'  (as fty_proto_t METRIC type, or quantity)
@@ -111,8 +123,6 @@ private:
     double      _value;
     uint64_t    _timestamp; // [s]
     uint64_t    _ttl;       // time to live [s]
-
-    std::string _element_destination_name;
 };
 
 inline bool operator==(const MetricInfo& lhs, const MetricInfo& rhs)
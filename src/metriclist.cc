@@ -17,43 +17,39 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "metriclist.h"
-#include <cassert>
-#include <cmath> // NAN is here
+#include "clock.h"
 
 void MetricList::addMetricInfo(const MetricInfo& metricInfo)
 {
-    std::string topic = metricInfo.generateTopic();
-
-    // find topic; if found -> replace metric, else add it
-    auto it = _knownMetrics.find(topic);
-    if (it != _knownMetrics.cend())
-        it->second = metricInfo;
-    else
-        _knownMetrics.emplace(topic, metricInfo);
+    Quantity quantity = quantity::fromString(metricInfo.getSource());
+    if (quantity != Quantity::UNKNOWN) {
+        addMeasurement(Measurement::fromMetricInfo(quantity, metricInfo));
+    }
 }
 
-MetricInfo MetricList::getMetricInfo(const std::string& topic) const
+void MetricList::addMeasurement(const Measurement& measurement)
 {
-    auto it = _knownMetrics.find(topic);
-    return (it != _knownMetrics.cend()) ? it->second : MetricInfo();
+    if (measurement.quantity != Quantity::UNKNOWN) {
+        _knownMetrics[size_t(measurement.quantity)] = measurement;
+    }
 }
 
-double MetricList::find(const std::string& topic) const
+MetricInfo MetricList::getMetricInfo(Quantity quantity) const
 {
-    auto it = _knownMetrics.find(topic);
-    return (it != _knownMetrics.cend()) ? it->second._value : std::nan("");
+    const auto& measurement = getMeasurement(quantity);
+    return measurement.isUnknown() ? MetricInfo() : measurement.toMetricInfo();
 }
 
-void MetricList::removeOldMetrics()
+size_t MetricList::removeOldMetrics()
 {
-    uint64_t now = uint64_t(::time(NULL));
-
-    std::map<std::string, MetricInfo>::iterator iter = _knownMetrics.begin();
-    while (iter != _knownMetrics.end()) {
-        if ((now - iter->second._timestamp) > iter->second.getTtl()) {
-            _knownMetrics.erase(iter++);
-        } else {
-            ++iter;
+    uint64_t now     = Clock::now();
+    size_t   removed = 0;
+
+    for (auto& measurement : _knownMetrics) {
+        if (!measurement.isUnknown() && measurement.expired(now)) {
+            measurement = Measurement();
+            removed++;
         }
     }
+    return removed;
 }
@@ -21,13 +21,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 /// @brief  This class is intended to handle set of current known metrics
 #pragma once
 
+#include "measurement.h"
 #include "metricinfo.h"
-#include <map>
-#include <string>
+#include <array>
 
-/// This class is intended to handle set of current known metrics.
+/// This class is intended to handle set of current known metrics of one device.
 ///
-/// You can create it, add new metrics, find known metrics by topic, and remove metrics that are not valid.
+/// You can create it, add new metrics, find known metrics by quantity, and remove metrics that are not valid.
+/// Metrics are stored as compact Measurement records, one slot per known quantity.
 class MetricList
 {
 public:
@@ -39,30 +40,49 @@ public:
 
     /// Adds new metric
     ///
-    /// This will add new metric if it isn't known to the listand update the value if it is known already.
-    /// Also it will update value of last added Metric.
+    /// This will add new metric if it isn't known to the list and update the value if it is known already.
+    /// Metrics of quantities unknown to the agent are ignored.
     /// @param[in] metricInfo - metric to add
     void addMetricInfo(const MetricInfo& metricInfo);
 
-    /// Gets metric by the topic
+    /// Adds new measurement
     ///
-    /// @param[in] topic - topic we are looking for
+    /// @param[in] measurement - measurement of a known quantity
+    void addMeasurement(const Measurement& measurement);
+
+    /// Gets metric by the quantity
+    ///
+    /// @param[in] quantity - quantity we are looking for
     /// @return MetricInfo       - if metric was found or
     ///         MetricInfo empty - if metric isn't found ( isUnknown() is true)
-    MetricInfo getMetricInfo(const std::string& topic) const;
+    MetricInfo getMetricInfo(Quantity quantity) const;
+
+    /// Gets measurement by the quantity
+    ///
+    /// @param[in] quantity - quantity we are looking for
+    /// @return measurement, isUnknown() is true if it isn't found
+    const Measurement& getMeasurement(Quantity quantity) const
+    {
+        return _knownMetrics[size_t(quantity)];
+    };
 
     /// Finds a value of the metric in the list
     ///
     /// To check if value is NAN or not use isnan() function from math.h
     ///
-    /// @param[in] topic - topic we are looking for
+    /// @param[in] quantity - quantity we are looking for
     /// @return NAN - if metric is not present in the list, value - otherwise
-    double find(const std::string& topic) const;
+    double find(Quantity quantity) const
+    {
+        return _knownMetrics[size_t(quantity)].value;
+    };
 
     /// Removes old metrics from the list (related to ttl of metrics)
-    void removeOldMetrics(void);
+    ///
+    /// @return number of removed metrics
+    size_t removeOldMetrics(void);
 
 private:
-    /// Metric list <topic, MetricInfo>
-    std::map<std::string, MetricInfo> _knownMetrics;
+    /// Metric list, indexed by Quantity, empty records for unknown metrics
+    std::array<Measurement, QUANTITY_COUNT> _knownMetrics;
 };
@@ -0,0 +1,281 @@
+/*  =========================================================================
+    metricrecord - Binary record of metric batches
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#include "metricrecord.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fty_log.h>
+
+namespace {
+
+const char MAGIC[8] = {'T', 'P', 'W', 'R', 'R', 'E', 'C', '1'};
+
+/// the biggest batch accepted by the reader [B]
+const uint32_t MAX_BATCH = 256 * 1024 * 1024;
+
+void s_putFixed(std::string& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back(char(value >> (8 * i)));
+    }
+}
+
+void s_putVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+/// reader of a batch
+struct Input
+{
+    const unsigned char* pos;
+    const unsigned char* end;
+    bool                 ok = true;
+
+    uint64_t fixed(int bytes)
+    {
+        if (end - pos < bytes) {
+            ok = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            value |= uint64_t(*pos++) << (8 * i);
+        }
+        return value;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos == end) {
+                break;
+            }
+            unsigned char byte = *pos++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+};
+
+} // namespace
+
+bool MetricRecorder::open(const std::string& path)
+{
+    close();
+    _file = fopen(path.c_str(), "wb");
+    if (!_file) {
+        log_error("can't create the record %s (%s)", path.c_str(), strerror(errno));
+        return false;
+    }
+    if (fwrite(MAGIC, sizeof(MAGIC), 1, _file) != 1) {
+        log_error("can't write the record %s (%s)", path.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+    _path = path;
+    log_info("recording metrics to %s", path.c_str());
+    return true;
+}
+
+void MetricRecorder::close()
+{
+    if (_file) {
+        fclose(_file);
+        _file = nullptr;
+    }
+    _path.clear();
+    _buffer.clear();
+    _strings.clear();
+    _count   = 0;
+    _batches = 0;
+}
+
+void MetricRecorder::beginBatch(uint64_t timestamp)
+{
+    if (_count > 0) {
+        // unfinished batch, strings of the batch are already known
+        endBatch();
+    }
+    _batchTimestamp = timestamp;
+}
+
+void MetricRecorder::putString(std::string_view s)
+{
+    auto it = _strings.find(std::string(s));
+    if (it != _strings.end()) {
+        s_putVarint(_buffer, uint64_t(it->second) + 1);
+        return;
+    }
+    uint32_t id = uint32_t(_strings.size());
+    _strings.emplace(std::string(s), id);
+    s_putVarint(_buffer, 0);
+    s_putVarint(_buffer, s.size());
+    _buffer.append(s.data(), s.size());
+}
+
+void MetricRecorder::add(const MetricSample& sample)
+{
+    if (!_file) {
+        return;
+    }
+    putString(sample.element);
+    putString(sample.quantity);
+    putString(sample.units);
+    uint64_t value;
+    static_assert(sizeof(value) == sizeof(sample.value), "double must be 64 bits");
+    memcpy(&value, &sample.value, sizeof(value));
+    s_putFixed(_buffer, value, 8);
+    // zigzag
+    int64_t delta = int64_t(sample.timestamp - _batchTimestamp);
+    s_putVarint(_buffer, (uint64_t(delta) << 1) ^ uint64_t(delta >> 63));
+    s_putVarint(_buffer, sample.ttl);
+    _count++;
+}
+
+bool MetricRecorder::endBatch()
+{
+    if (!_file || (_count == 0)) {
+        return _file != nullptr;
+    }
+    std::string header;
+    s_putFixed(header, _batchTimestamp, 8);
+    s_putVarint(header, _count);
+    std::string size;
+    s_putFixed(size, header.size() + _buffer.size(), 4);
+
+    bool ok = (fwrite(size.data(), size.size(), 1, _file) == 1) &&
+              (fwrite(header.data(), header.size(), 1, _file) == 1) &&
+              (fwrite(_buffer.data(), _buffer.size(), 1, _file) == 1) && (fflush(_file) == 0);
+    _buffer.clear();
+    _count = 0;
+    if (!ok) {
+        log_error("can't write the record %s (%s), recording stopped", _path.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+    _batches++;
+    return true;
+}
+
+bool MetricReplay::open(const std::string& path)
+{
+    close();
+    _file = fopen(path.c_str(), "rb");
+    if (!_file) {
+        _error = "can't open " + path + " (" + strerror(errno) + ")";
+        return false;
+    }
+    char magic[sizeof(MAGIC)];
+    if ((fread(magic, sizeof(magic), 1, _file) != 1) || (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)) {
+        _error = path + " is not a metric record";
+        close();
+        return false;
+    }
+    _error.clear();
+    return true;
+}
+
+void MetricReplay::close()
+{
+    if (_file) {
+        fclose(_file);
+        _file = nullptr;
+    }
+    _buffer.clear();
+    _strings.clear();
+}
+
+bool MetricReplay::next(RecordedBatch& batch)
+{
+    if (!_file) {
+        return false;
+    }
+    unsigned char size[4];
+    size_t        read = fread(size, 1, sizeof(size), _file);
+    if (read == 0) {
+        return false; // end of the record
+    }
+    uint32_t length = uint32_t(size[0]) | (uint32_t(size[1]) << 8) | (uint32_t(size[2]) << 16) |
+                      (uint32_t(size[3]) << 24);
+    if ((read != sizeof(size)) || (length > MAX_BATCH)) {
+        _error = "corrupted batch header";
+        return false;
+    }
+    _buffer.resize(length);
+    if ((length > 0) && (fread(&_buffer[0], length, 1, _file) != 1)) {
+        _error = "truncated batch";
+        return false;
+    }
+
+    Input in{reinterpret_cast<const unsigned char*>(_buffer.data()),
+        reinterpret_cast<const unsigned char*>(_buffer.data()) + _buffer.size()};
+    auto string = [this, &in](std::string& out) {
+        uint64_t id = in.varint();
+        if (id == 0) {
+            uint64_t len = in.varint();
+            if (!in.ok || (uint64_t(in.end - in.pos) < len)) {
+                in.ok = false;
+                return;
+            }
+            _strings.emplace_back(reinterpret_cast<const char*>(in.pos), len);
+            in.pos += len;
+            out = _strings.back();
+        } else if (id <= _strings.size()) {
+            out = _strings[id - 1];
+        } else {
+            in.ok = false;
+        }
+    };
+
+    batch.timestamp = in.fixed(8);
+    uint64_t count  = in.varint();
+    batch.metrics.resize(in.ok ? std::min<uint64_t>(count, length) : 0);
+    for (auto& metric : batch.metrics) {
+        string(metric.element);
+        string(metric.quantity);
+        string(metric.units);
+        uint64_t value = in.fixed(8);
+        memcpy(&metric.value, &value, sizeof(value));
+        uint64_t delta   = in.varint();
+        metric.timestamp = batch.timestamp + uint64_t(int64_t(delta >> 1) ^ -int64_t(delta & 1));
+        metric.ttl       = uint32_t(in.varint());
+        if (!in.ok) {
+            break;
+        }
+    }
+    if (!in.ok || (count > batch.metrics.size())) {
+        _error = "corrupted batch";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,155 @@
+/*  =========================================================================
+    metricrecord - Binary record of metric batches
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+/// @file   metricrecord.h
+/// @brief  Binary record of metric batches (record/replay of the shm load)
+
+#pragma once
+
+#include "measurement.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// one recorded metric
+struct RecordedMetric
+{
+    std::string element;
+    std::string quantity;
+    std::string units;
+    double      value     = 0; ///< NAN if the value wasn't a number
+    uint64_t    timestamp = 0; ///< [s]
+    uint32_t    ttl       = 0; ///< [s]
+
+    /// view of the metric, valid as long as the record is
+    MetricSample sample() const
+    {
+        return MetricSample(element, quantity, units, value, timestamp, ttl);
+    };
+};
+
+/// metrics read by one poll
+struct RecordedBatch
+{
+    uint64_t                    timestamp = 0; ///< [s]
+    std::vector<RecordedMetric> metrics;
+};
+
+/// Writer of the record
+///
+/// File format (little endian):
+///
+///     "TPWRREC1"
+///     batch: u32 size of the rest of the batch, u64 timestamp, varint count, metrics
+///     metric: string element, string quantity, string units, f64 value,
+///             zigzag varint timestamp - batch timestamp, varint ttl
+///     string: varint 0, varint length, bytes (new string, gets the next ID)
+///             or varint ID + 1 (string seen before)
+///
+/// Strings are shared by the whole file, so a batch can be read only after the previous ones.
+class MetricRecorder
+{
+public:
+    MetricRecorder() = default;
+    ~MetricRecorder()
+    {
+        close();
+    };
+    MetricRecorder(const MetricRecorder&) = delete;
+    MetricRecorder& operator=(const MetricRecorder&) = delete;
+
+    /// create the file (truncated if it exists)
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const
+    {
+        return _file != nullptr;
+    };
+    /// path of the open file
+    const std::string& path() const
+    {
+        return _path;
+    };
+
+    /// start a batch of metrics
+    void beginBatch(uint64_t timestamp);
+    /// add metric to the batch
+    void add(const MetricSample& sample);
+    /// write the batch, empty batches are not written
+    ///
+    /// @return false if the file can't be written (the file is closed)
+    bool endBatch();
+
+    /// number of written batches
+    uint64_t batches() const
+    {
+        return _batches;
+    };
+
+private:
+    FILE*                                     _file = nullptr;
+    std::string                               _path;
+    std::string                               _buffer;
+    std::unordered_map<std::string, uint32_t> _strings;
+    uint64_t                                  _batchTimestamp = 0;
+    uint32_t                                  _count          = 0;
+    uint64_t                                  _batches        = 0;
+
+    void putString(std::string_view s);
+};
+
+/// Reader of the record written by MetricRecorder
+class MetricReplay
+{
+public:
+    MetricReplay() = default;
+    ~MetricReplay()
+    {
+        close();
+    };
+    MetricReplay(const MetricReplay&) = delete;
+    MetricReplay& operator=(const MetricReplay&) = delete;
+
+    /// open the file and check its header
+    bool open(const std::string& path);
+    void close();
+
+    /// read the next batch
+    ///
+    /// @return false at the end of the file or if the file is corrupted (see error())
+    bool next(RecordedBatch& batch);
+
+    /// description of the error, empty at the end of a valid file
+    const std::string& error() const
+    {
+        return _error;
+    };
+
+private:
+    FILE*                    _file = nullptr;
+    std::string              _buffer;
+    std::vector<std::string> _strings;
+    std::string              _error;
+};
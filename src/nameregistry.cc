@@ -0,0 +1,106 @@
+/*  =========================================================================
+    nameregistry - Interned names of assets and units
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#include "nameregistry.h"
+#include <functional>
+
+NameRegistry::NameRegistry()
+    : _names{std::string()}
+    , _slots(64, NONE)
+{
+}
+
+size_t NameRegistry::slot(std::string_view name) const
+{
+    size_t mask = _slots.size() - 1;
+    size_t i    = std::hash<std::string_view>{}(name) & mask;
+    while ((_slots[i] != NONE) && (_names[_slots[i]] != name)) {
+        i = (i + 1) & mask; // linear probing
+    }
+    return i;
+}
+
+uint32_t NameRegistry::find(std::string_view name) const
+{
+    if (name.empty()) {
+        return NONE;
+    }
+    return _slots[slot(name)];
+}
+
+uint32_t NameRegistry::intern(std::string_view name)
+{
+    if (name.empty()) {
+        return NONE;
+    }
+    size_t i = slot(name);
+    if (_slots[i] != NONE) {
+        return _slots[i];
+    }
+
+    uint32_t id = uint32_t(_names.size());
+    _names.emplace_back(name);
+    _slots[i] = id;
+    if (_names.size() * 2 > _slots.size()) {
+        // keep load factor under 1/2
+        grow();
+    }
+    return id;
+}
+
+const std::string& NameRegistry::name(uint32_t id) const
+{
+    return (id < _names.size()) ? _names[id] : _names[NONE];
+}
+
+void NameRegistry::grow()
+{
+    _slots.assign(_slots.size() * 2, NONE);
+    for (uint32_t id = 1; id < _names.size(); ++id) {
+        _slots[slot(_names[id])] = id;
+    }
+}
+
+size_t NameRegistry::memoryUsage() const
+{
+    static const size_t inplace = std::string().capacity();
+
+    size_t result = _slots.capacity() * sizeof(uint32_t) + _names.size() * sizeof(std::string);
+    for (const auto& name : _names) {
+        if (name.capacity() > inplace) {
+            // not stored in the string object itself (SSO)
+            result += name.capacity() + 1;
+        }
+    }
+    return result;
+}
+
+NameRegistry& NameRegistry::elements()
+{
+    static NameRegistry registry;
+    return registry;
+}
+
+NameRegistry& NameRegistry::units()
+{
+    static NameRegistry registry;
+    return registry;
+}
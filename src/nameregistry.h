@@ -0,0 +1,79 @@
+/*  =========================================================================
+    nameregistry - Interned names of assets and units
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// @file   nameregistry.h
+/// @brief  Interned names of assets and units
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Registry of interned strings
+///
+/// Each name gets a small numeric ID, which never changes and is never
+/// released. Lookup is an open addressing hash over the stored names.
+/// The registry is not thread safe, it's used under the configuration lock.
+class NameRegistry
+{
+public:
+    /// ID of the empty name
+    static constexpr uint32_t NONE = 0;
+
+    NameRegistry();
+
+    /// returns ID of the name, the name is added if it's not known yet
+    uint32_t intern(std::string_view name);
+
+    /// returns ID of the name, NONE if it's not known
+    uint32_t find(std::string_view name) const;
+
+    /// returns the name of ID, empty string for unknown IDs
+    const std::string& name(uint32_t id) const;
+
+    /// number of names (including the empty one)
+    size_t size() const
+    {
+        return _names.size();
+    };
+
+    /// estimated heap memory used by the registry [B]
+    size_t memoryUsage() const;
+
+    /// registry of asset names (devices, racks and DCs)
+    static NameRegistry& elements();
+    /// registry of units of measurements
+    static NameRegistry& units();
+
+private:
+    /// ID -> name, stable addresses, ID 0 is the empty name
+    std::deque<std::string> _names;
+    /// hash table of IDs, NONE for empty slots (size is power of 2)
+    std::vector<uint32_t> _slots;
+
+    /// slot of the name or the empty slot where it belongs
+    size_t slot(std::string_view name) const;
+    /// double the table and rehash
+    void grow();
+};
@@ -0,0 +1,72 @@
+/*  =========================================================================
+    ownerindex - Index of units powered by a device
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#include "ownerindex.h"
+#include <algorithm>
+
+void OwnerIndex::clear()
+{
+    _offsets.clear();
+    _owners.clear();
+    _edges.clear();
+}
+
+void OwnerIndex::add(uint32_t device, TPUnit* owner)
+{
+    _edges.emplace_back(device, owner);
+}
+
+void OwnerIndex::build()
+{
+    // the same edge can be added more times (device listed twice)
+    std::sort(_edges.begin(), _edges.end());
+    _edges.erase(std::unique(_edges.begin(), _edges.end()), _edges.end());
+
+    uint32_t rows = _edges.empty() ? 0 : _edges.back().first + 1;
+    _offsets.assign(rows + 1, 0);
+    _owners.clear();
+    _owners.reserve(_edges.size());
+
+    // count owners of devices, then prefix sum
+    for (const auto& edge : _edges) {
+        _offsets[edge.first + 1]++;
+    }
+    for (uint32_t row = 0; row < rows; ++row) {
+        _offsets[row + 1] += _offsets[row];
+    }
+    // edges are sorted, so owners are already in rows
+    for (const auto& edge : _edges) {
+        _owners.push_back(edge.second);
+    }
+
+    _edges.clear();
+    _edges.shrink_to_fit();
+}
+
+OwnerIndex::Owners OwnerIndex::owners(uint32_t device) const
+{
+    Owners result;
+    if (size_t(device) + 1 < _offsets.size()) {
+        result.first = _owners.data() + _offsets[device];
+        result.last  = _owners.data() + _offsets[device + 1];
+    }
+    return result;
+}
@@ -0,0 +1,97 @@
+/*  =========================================================================
+    ownerindex - Index of units powered by a device
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// @file   ownerindex.h
+/// @brief  Index of units powered by a device
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class TPUnit;
+
+/// One-to-many index device -> units (racks or DCs)
+///
+/// Compressed sparse rows indexed by NameRegistry::elements() ID of the device:
+/// owners of device d are _owners[_offsets[d] .. _offsets[d + 1]).
+class OwnerIndex
+{
+public:
+    /// range of owners
+    struct Owners
+    {
+        TPUnit* const* first = nullptr;
+        TPUnit* const* last  = nullptr;
+
+        TPUnit* const* begin() const
+        {
+            return first;
+        };
+        TPUnit* const* end() const
+        {
+            return last;
+        };
+        size_t size() const
+        {
+            return size_t(last - first);
+        };
+        bool empty() const
+        {
+            return first == last;
+        };
+    };
+
+    /// remove all edges
+    void clear();
+
+    /// add edge device -> owner, the index must be built before use
+    void add(uint32_t device, TPUnit* owner);
+
+    /// build rows from the added edges
+    void build();
+
+    /// owners of the device
+    Owners owners(uint32_t device) const;
+
+    /// number of edges
+    size_t size() const
+    {
+        return _owners.size();
+    };
+
+    /// estimated heap memory used by the index [B]
+    size_t memoryUsage() const
+    {
+        return _offsets.capacity() * sizeof(uint32_t) + _owners.capacity() * sizeof(TPUnit*) +
+               _edges.capacity() * sizeof(_edges[0]);
+    };
+
+private:
+    /// row offsets, indexed by device ID
+    std::vector<uint32_t> _offsets;
+    /// owners of all devices
+    std::vector<TPUnit*> _owners;
+    /// edges added since the last build
+    std::vector<std::pair<uint32_t, TPUnit*>> _edges;
+};
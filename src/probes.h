@@ -0,0 +1,74 @@
+/*  =========================================================================
+    probes - USDT probes of the hot paths
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+/// @file   probes.h
+/// @brief  USDT (SystemTap/bpftrace) probes of the ingest, calculation and publishing paths
+///
+/// A probe compiles to a single nop, its arguments are only read when a tracer is attached:
+///
+///     bpftrace -e 'usdt:/usr/bin/fty-metric-tpower:batch__start { @start[tid] = nsecs; }
+///         usdt:/usr/bin/fty-metric-tpower:batch__done { @us = hist((nsecs - @start[tid]) / 1000); }'
+///
+/// Probes are empty if <sys/sdt.h> (systemtap-sdt-devel) isn't available or TPOWER_NO_PROBES is defined.
+/// The build defines TPOWER_REQUIRE_PROBES (CMake option WITH_PROBES), then the header is mandatory.
+
+#pragma once
+
+#if defined(__has_include) && !defined(TPOWER_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TPOWER_PROBES 1
+#endif
+#endif
+
+#if defined(TPOWER_REQUIRE_PROBES) && !defined(TPOWER_PROBES)
+#error "USDT probes required but <sys/sdt.h> isn't available (systemtap-sdt-dev)"
+#endif
+
+#ifdef TPOWER_PROBES
+#define TPOWER_PROBE0(name)             DTRACE_PROBE(fty_metric_tpower, name)
+#define TPOWER_PROBE1(name, a)          DTRACE_PROBE1(fty_metric_tpower, name, a)
+#define TPOWER_PROBE2(name, a, b)       DTRACE_PROBE2(fty_metric_tpower, name, a, b)
+#define TPOWER_PROBE3(name, a, b, c)    DTRACE_PROBE3(fty_metric_tpower, name, a, b, c)
+#define TPOWER_PROBE4(name, a, b, c, d) DTRACE_PROBE4(fty_metric_tpower, name, a, b, c, d)
+#else
+// arguments are not evaluated, sizeof only keeps them used
+#define TPOWER_PROBE0(name)                                                                                            \
+    do {                                                                                                               \
+    } while (0)
+#define TPOWER_PROBE1(name, a)                                                                                         \
+    do {                                                                                                               \
+        (void)sizeof(a);                                                                                               \
+    } while (0)
+#define TPOWER_PROBE2(name, a, b)                                                                                      \
+    do {                                                                                                               \
+        (void)sizeof(a), (void)sizeof(b);                                                                              \
+    } while (0)
+#define TPOWER_PROBE3(name, a, b, c)                                                                                   \
+    do {                                                                                                               \
+        (void)sizeof(a), (void)sizeof(b), (void)sizeof(c);                                                             \
+    } while (0)
+#define TPOWER_PROBE4(name, a, b, c, d)                                                                                \
+    do {                                                                                                               \
+        (void)sizeof(a), (void)sizeof(b), (void)sizeof(c), (void)sizeof(d);                                            \
+    } while (0)
+#endif
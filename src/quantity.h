@@ -0,0 +1,205 @@
+/*  =========================================================================
+    quantity - Quantities known to the agent
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// @file   quantity.h
+/// @brief  Quantities known to the agent, parsed by a compile-time perfect hash
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/// quantity of a metric consumed or produced by the agent
+///
+/// Order of the totals is the order of the DC totals (see TPUnit::calculate), measurements
+/// used only as inputs of the totals follow.
+enum class Quantity : uint8_t
+{
+    REALPOWER_DEFAULT = 0,
+    REALPOWER_INPUT_L1,
+    REALPOWER_INPUT_L2,
+    REALPOWER_INPUT_L3,
+    REALPOWER_OUTPUT_L1,
+    REALPOWER_OUTPUT_L2,
+    REALPOWER_OUTPUT_L3,
+    POWER_INPUT_L1, ///< apparent power
+    POWER_INPUT_L2,
+    POWER_INPUT_L3,
+    POWER_INPUT_IMBALANCE, ///< max deviation of phase apparent power from their average [%]
+    CURRENT_INPUT_L1,
+    CURRENT_INPUT_L2,
+    CURRENT_INPUT_L3,
+    VOLTAGE_INPUT_L1,
+    VOLTAGE_INPUT_L2,
+    VOLTAGE_INPUT_L3,
+    COUNT,
+    UNKNOWN = COUNT,
+};
+
+/// number of known quantities
+constexpr size_t QUANTITY_COUNT = size_t(Quantity::COUNT);
+
+static_assert(QUANTITY_COUNT <= 32, "quantity masks are 32 bits");
+
+namespace quantity {
+
+/// names of quantities, indexed by Quantity
+constexpr std::array<std::string_view, QUANTITY_COUNT> names = {
+    "realpower.default",
+    "realpower.input.L1",
+    "realpower.input.L2",
+    "realpower.input.L3",
+    "realpower.output.L1",
+    "realpower.output.L2",
+    "realpower.output.L3",
+    "power.input.L1",
+    "power.input.L2",
+    "power.input.L3",
+    "power.input.imbalance",
+    "current.input.L1",
+    "current.input.L2",
+    "current.input.L3",
+    "voltage.input.L1-N",
+    "voltage.input.L2-N",
+    "voltage.input.L3-N",
+};
+
+/// name of the quantity (null terminated)
+constexpr const char* name(Quantity q)
+{
+    return (q < Quantity::COUNT) ? names[size_t(q)].data() : "unknown";
+}
+
+/// units of the quantity
+constexpr const char* units(Quantity q)
+{
+    if (q < Quantity::POWER_INPUT_L1) {
+        return "W";
+    }
+    if (q < Quantity::POWER_INPUT_IMBALANCE) {
+        return "VA";
+    }
+    if (q == Quantity::POWER_INPUT_IMBALANCE) {
+        return "%";
+    }
+    if (q < Quantity::VOLTAGE_INPUT_L1) {
+        return "A";
+    }
+    return (q < Quantity::COUNT) ? "V" : "";
+}
+
+/// bit of the quantity in a quantity mask
+constexpr uint32_t mask(Quantity q)
+{
+    return (q < Quantity::COUNT) ? (uint32_t(1) << unsigned(q)) : 0;
+}
+
+/// measurements of apparent power inputs, a change affects more totals (phase and imbalance)
+constexpr uint32_t APPARENT_INPUTS = mask(Quantity::POWER_INPUT_L1) | mask(Quantity::POWER_INPUT_L2) |
+                                     mask(Quantity::POWER_INPUT_L3) | mask(Quantity::CURRENT_INPUT_L1) |
+                                     mask(Quantity::CURRENT_INPUT_L2) | mask(Quantity::CURRENT_INPUT_L3) |
+                                     mask(Quantity::VOLTAGE_INPUT_L1) | mask(Quantity::VOLTAGE_INPUT_L2) |
+                                     mask(Quantity::VOLTAGE_INPUT_L3);
+
+/// apparent power total of the phase computed from the input (see APPARENT_INPUTS)
+constexpr Quantity apparentTotal(Quantity q)
+{
+    switch (q) {
+        case Quantity::POWER_INPUT_L1:
+        case Quantity::CURRENT_INPUT_L1:
+        case Quantity::VOLTAGE_INPUT_L1:
+            return Quantity::POWER_INPUT_L1;
+        case Quantity::POWER_INPUT_L2:
+        case Quantity::CURRENT_INPUT_L2:
+        case Quantity::VOLTAGE_INPUT_L2:
+            return Quantity::POWER_INPUT_L2;
+        case Quantity::POWER_INPUT_L3:
+        case Quantity::CURRENT_INPUT_L3:
+        case Quantity::VOLTAGE_INPUT_L3:
+            return Quantity::POWER_INPUT_L3;
+        default:
+            return Quantity::UNKNOWN;
+    }
+}
+
+namespace detail {
+
+    /// seed of the hash, change it if the static_assert below fails
+    constexpr uint32_t HASH_SEED = 2166136268u;
+
+    /// size of the hash table (power of 2)
+    constexpr size_t TABLE_SIZE = 64;
+
+    /// FNV-1a
+    constexpr uint32_t hash(std::string_view s)
+    {
+        uint32_t h = HASH_SEED;
+        for (char c : s) {
+            h = (h ^ uint8_t(c)) * 16777619u;
+        }
+        return h;
+    }
+
+    constexpr size_t slot(std::string_view s)
+    {
+        return hash(s) & (TABLE_SIZE - 1);
+    }
+
+    /// slot -> quantity, UNKNOWN for empty slots
+    constexpr std::array<Quantity, TABLE_SIZE> buildTable()
+    {
+        std::array<Quantity, TABLE_SIZE> table{};
+        for (auto& entry : table) {
+            entry = Quantity::UNKNOWN;
+        }
+        for (size_t q = 0; q < QUANTITY_COUNT; ++q) {
+            table[slot(names[q])] = Quantity(q);
+        }
+        return table;
+    }
+
+    constexpr std::array<Quantity, TABLE_SIZE> table = buildTable();
+
+    /// every name owns its slot
+    constexpr bool isPerfect()
+    {
+        for (size_t q = 0; q < QUANTITY_COUNT; ++q) {
+            if (table[slot(names[q])] != Quantity(q)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static_assert(isPerfect(), "quantity hash has collisions, change HASH_SEED or TABLE_SIZE");
+
+} // namespace detail
+
+/// parse the quantity, returns Quantity::UNKNOWN for names not known to the agent
+constexpr Quantity fromString(std::string_view s)
+{
+    Quantity q = detail::table[detail::slot(s)];
+    return ((q != Quantity::UNKNOWN) && (names[size_t(q)] == s)) ? q : Quantity::UNKNOWN;
+}
+
+} // namespace quantity
@@ -0,0 +1,191 @@
+/*  =========================================================================
+    reactor - Single threaded event loop on epoll and timerfd
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#include "reactor.h"
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fty_log.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+
+/// rounds of socket handlers before timers get their turn
+const int SOCKET_ROUNDS = 64;
+
+} // namespace
+
+Reactor::Reactor()
+    : _epoll(epoll_create1(EPOLL_CLOEXEC))
+{
+    if (_epoll < 0) {
+        log_error("epoll_create1() failed: %s", strerror(errno));
+    }
+}
+
+Reactor::~Reactor()
+{
+    for (const auto& source : _sources) {
+        if (source.kind == Kind::TIMER) {
+            close(source.fd);
+        }
+    }
+    if (_epoll >= 0) {
+        close(_epoll);
+    }
+}
+
+uint64_t Reactor::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000 + uint64_t(ts.tv_nsec) / 1000000;
+}
+
+bool Reactor::add(Source&& source)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events   = EPOLLIN | ((source.kind == Kind::SOCKET) ? uint32_t(EPOLLET) : 0u);
+    event.data.u64 = _sources.size();
+    if ((_epoll < 0) || (epoll_ctl(_epoll, EPOLL_CTL_ADD, source.fd, &event) != 0)) {
+        log_error("cannot watch descriptor %d: %s", source.fd, strerror(errno));
+        return false;
+    }
+    if (source.kind == Kind::SOCKET) {
+        _sockets.push_back(_sources.size());
+    }
+    _sources.push_back(std::move(source));
+    return true;
+}
+
+bool Reactor::addReader(int fd, Handler handler)
+{
+    return add({Kind::READER, fd, std::move(handler), nullptr});
+}
+
+bool Reactor::addSocket(int fd, Readable readable, Handler handler)
+{
+    return add({Kind::SOCKET, fd, std::move(handler), std::move(readable)});
+}
+
+int Reactor::addTimer(Handler handler)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        log_error("timerfd_create() failed: %s", strerror(errno));
+        return -1;
+    }
+    int timer = int(_sources.size());
+    if (!add({Kind::TIMER, fd, std::move(handler), nullptr})) {
+        close(fd);
+        return -1;
+    }
+    return timer;
+}
+
+void Reactor::armAt(int timer, uint64_t deadline)
+{
+    Source& source = _sources[size_t(timer)];
+    if (source.deadline == deadline) {
+        // most of re-arms don't move the deadline, save the syscall
+        return;
+    }
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    // deadline in the past fires immediately, 0 disarms the timer
+    spec.it_value.tv_sec  = time_t(deadline / 1000);
+    spec.it_value.tv_nsec = long(deadline % 1000) * 1000000;
+    if ((deadline != 0) && (spec.it_value.tv_sec == 0) && (spec.it_value.tv_nsec == 0)) {
+        spec.it_value.tv_nsec = 1;
+    }
+    if (timerfd_settime(source.fd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+        log_error("timerfd_settime() failed: %s", strerror(errno));
+        return;
+    }
+    source.deadline = deadline;
+}
+
+uint64_t Reactor::deadline(int timer) const
+{
+    return _sources[size_t(timer)].deadline;
+}
+
+bool Reactor::dispatchSockets()
+{
+    for (int round = 0; round < SOCKET_ROUNDS; ++round) {
+        bool dispatched = false;
+        for (size_t index : _sockets) {
+            if (_stopped) {
+                return false;
+            }
+            Source& source = _sources[index];
+            if (source.readable()) {
+                source.handler();
+                dispatched = true;
+            }
+        }
+        if (!dispatched) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Reactor::run()
+{
+    _stopped = false;
+    struct epoll_event events[16];
+    while (!_stopped) {
+        bool pending = dispatchSockets();
+        if (_stopped) {
+            break;
+        }
+        // sockets with pending messages don't block the timers
+        int count = epoll_wait(_epoll, events, 16, pending ? 0 : -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("epoll_wait() failed: %s", strerror(errno));
+            break;
+        }
+        _wakeups++;
+        for (int i = 0; (i < count) && !_stopped; ++i) {
+            Source& source = _sources[size_t(events[i].data.u64)];
+            if (source.kind == Kind::TIMER) {
+                uint64_t expirations = 0;
+                if (read(source.fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                    // re-armed by a handler dispatched in the same wake-up
+                    continue;
+                }
+                source.deadline = 0;
+                source.handler();
+            } else if (source.kind == Kind::READER) {
+                source.handler();
+            }
+            // sockets are dispatched by readable()
+        }
+    }
+}
@@ -0,0 +1,123 @@
+/*  =========================================================================
+    reactor - Single threaded event loop on epoll and timerfd
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+/// @file   reactor.h
+/// @brief  Single threaded event loop on epoll and timerfd
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/// Event loop of the agent
+///
+/// Sources are file descriptors and one-shot timers (a timerfd each), so the loop
+/// sleeps in epoll_wait() until something is to be done. ZeroMQ sockets are
+/// registered by their ZMQ_FD, which is edge triggered and doesn't tell which
+/// events are pending: their handlers are called while readable() says so, after
+/// every wake-up and every dispatched handler (a send on the socket may consume
+/// the edge of a message received meanwhile).
+///
+/// Sources are registered before run(), handlers may stop the loop and arm timers.
+class Reactor
+{
+public:
+    using Handler  = std::function<void()>;
+    using Readable = std::function<bool()>;
+
+    Reactor();
+    ~Reactor();
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    /// false if epoll can't be created
+    bool valid() const
+    {
+        return _epoll >= 0;
+    };
+
+    /// call the handler when the descriptor is readable (level triggered)
+    bool addReader(int fd, Handler handler);
+    /// edge triggered source (ZMQ_FD), the handler reads one message and is called while readable() is true
+    bool addSocket(int fd, Readable readable, Handler handler);
+    /// one-shot timer, disarmed until armAt() or armIn()
+    ///
+    /// @return timer ID, -1 if the timerfd can't be created
+    int addTimer(Handler handler);
+
+    /// arm the timer at the monotonic time [ms], 0 disarms it
+    void armAt(int timer, uint64_t deadline);
+    /// arm the timer after the delay [ms]
+    void armIn(int timer, uint64_t delay)
+    {
+        armAt(timer, now() + delay);
+    };
+    /// monotonic time the timer is armed at [ms], 0 if disarmed
+    uint64_t deadline(int timer) const;
+
+    /// dispatch events until stop()
+    void run();
+    void stop()
+    {
+        _stopped = true;
+    };
+
+    /// number of returns from epoll_wait()
+    uint64_t wakeups() const
+    {
+        return _wakeups;
+    };
+
+    /// monotonic time [ms]
+    static uint64_t now();
+
+private:
+    enum class Kind
+    {
+        READER,
+        SOCKET,
+        TIMER
+    };
+    struct Source
+    {
+        Kind     kind;
+        int      fd;
+        Handler  handler;
+        Readable readable;
+        uint64_t deadline = 0; ///< timers [ms], 0 if disarmed
+    };
+
+    /// call handlers of sockets with pending messages, one message per socket in a round
+    ///
+    /// @return true if messages are still pending after the limit of rounds
+    bool dispatchSockets();
+
+    bool add(Source&& source);
+
+    int                 _epoll   = -1;
+    bool                _stopped = false;
+    uint64_t            _wakeups = 0;
+    std::vector<Source> _sources;
+    /// indexes of socket sources
+    std::vector<size_t> _sockets;
+};
@@ -0,0 +1,86 @@
+/*  =========================================================================
+    rollingwindow - Rolling statistics of a total
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#include "rollingwindow.h"
+#include <algorithm>
+
+RollingWindow::RollingWindow(uint32_t seconds)
+    : _seconds(rounded(seconds))
+    , _width(_seconds / BUCKETS)
+{
+}
+
+void RollingWindow::add(uint64_t timestamp, double value)
+{
+    if (std::isnan(value)) {
+        return;
+    }
+    uint64_t slice  = timestamp / _width;
+    Bucket&  bucket = _buckets[slice % BUCKETS];
+    if (bucket.slice != slice) {
+        // the ring went round, drop the old slice
+        bucket         = Bucket();
+        bucket.slice   = slice;
+        bucket.minimum = value;
+        bucket.maximum = value;
+    }
+    bucket.sum += value;
+    bucket.minimum = std::min(bucket.minimum, value);
+    bucket.maximum = std::max(bucket.maximum, value);
+    bucket.count++;
+}
+
+RollingWindow::Stats RollingWindow::stats(uint64_t now) const
+{
+    Stats    result;
+    uint64_t last = now / _width;
+    double   sum  = 0;
+    for (const auto& bucket : _buckets) {
+        if ((bucket.count == 0) || (bucket.slice > last) || (last - bucket.slice >= BUCKETS)) {
+            continue;
+        }
+        if (result.count == 0) {
+            result.minimum = bucket.minimum;
+            result.maximum = bucket.maximum;
+        } else {
+            result.minimum = std::min(result.minimum, bucket.minimum);
+            result.maximum = std::max(result.maximum, bucket.maximum);
+        }
+        sum += bucket.sum;
+        result.count += bucket.count;
+    }
+    if (result.count > 0) {
+        result.average = sum / result.count;
+    }
+    return result;
+}
+
+std::string RollingWindow::name() const
+{
+    if (_seconds % 3600 == 0) {
+        return std::to_string(_seconds / 3600) + "h";
+    }
+    if (_seconds % 60 == 0) {
+        return std::to_string(_seconds / 60) + "m";
+    }
+    return std::to_string(_seconds) + "s";
+}
@@ -0,0 +1,95 @@
+/*  =========================================================================
+    rollingwindow - Rolling statistics of a total
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+/// @file   rollingwindow.h
+/// @brief  Rolling statistics of a total over a fixed time window
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+/// Average, minimum and maximum of values over the last window
+///
+/// The window is split into BUCKETS time slices kept in a ring. Adding a
+/// value is O(1), statistics are computed from the buckets, so memory
+/// doesn't depend on the rate of values. The oldest slice leaves the
+/// window as a whole, so the window is [seconds - bucket width, seconds].
+class RollingWindow
+{
+public:
+    /// number of time slices
+    static constexpr uint32_t BUCKETS = 15;
+
+    /// statistics of the window, NAN if no value was added within the window
+    struct Stats
+    {
+        double   average = std::nan("");
+        double   minimum = std::nan("");
+        double   maximum = std::nan("");
+        uint32_t count   = 0;
+    };
+
+    /// @param seconds - length of the window [s], rounded to a multiple of BUCKETS
+    explicit RollingWindow(uint32_t seconds = 60);
+
+    /// the nearest length of a window split into whole seconds, at least BUCKETS [s]
+    static uint32_t rounded(uint32_t seconds)
+    {
+        return BUCKETS * std::max<uint32_t>((seconds + BUCKETS / 2) / BUCKETS, 1);
+    }
+
+    /// add value measured at timestamp [s]
+    void add(uint64_t timestamp, double value);
+
+    /// statistics of values within the window ending at now [s]
+    Stats stats(uint64_t now) const;
+
+    /// length of the window [s]
+    uint32_t seconds() const
+    {
+        return _seconds;
+    };
+
+    /// name of the window used in metrics: 90s, 15m, 1h
+    std::string name() const;
+
+private:
+    struct Bucket
+    {
+        /// number of the time slice (timestamp / width), UINT64_MAX if empty
+        uint64_t slice   = UINT64_MAX;
+        double   sum     = 0;
+        double   minimum = 0;
+        double   maximum = 0;
+        uint32_t count   = 0;
+    };
+
+    std::array<Bucket, BUCKETS> _buckets;
+    /// length of the window [s]
+    uint32_t _seconds;
+    /// length of one time slice [s]
+    uint32_t _width;
+};
@@ -0,0 +1,219 @@
+/*  =========================================================================
+    stagestats - Latency histograms and counters of the processing stages
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#include "stagestats.h"
+#include <cinttypes>
+#include <cstdio>
+
+std::atomic<bool>     StageStats::s_enabled{true};
+LatencyHistogram      StageStats::s_histograms[STAGE_COUNT];
+LatencyHistogram      StageStats::s_ages[AGE_COUNT];
+std::atomic<uint64_t> StageStats::s_counters[COUNTER_COUNT] = {};
+
+uint64_t LatencyHistogram::mean() const
+{
+    uint64_t n = count();
+    return (n > 0) ? _sum.load(std::memory_order_relaxed) / n : 0;
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const
+{
+    uint64_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+    // rank of the value, counters may move while they are read
+    uint64_t rank = uint64_t(double(n) * percent / 100 + 0.5);
+    rank          = (rank > 0) ? rank : 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += _buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // the bucket is wider than the biggest value
+            uint64_t value = bucketMax(i);
+            return (value < max()) ? value : max();
+        }
+    }
+    return max();
+}
+
+uint64_t LatencyHistogram::bucketMax(size_t index)
+{
+    if (index < (1u << SUB_BITS)) {
+        return uint64_t(index);
+    }
+    unsigned shift = unsigned(index >> SUB_BITS) - 1;
+    uint64_t sub   = uint64_t(index & ((1u << SUB_BITS) - 1));
+    return (((uint64_t(1) << SUB_BITS) + sub) << shift) + (uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto& bucket : _buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    _count.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+const char* StageStats::name(Stage stage)
+{
+    switch (stage) {
+        case Stage::SHM_READ:
+            return "shm_read";
+        case Stage::PARSE:
+            return "parse";
+        case Stage::CALCULATE:
+            return "calculate";
+        case Stage::ADVERTISE:
+            return "advertise";
+        case Stage::WRITE_METRIC:
+            return "write_metric";
+        case Stage::CONFIGURE:
+            return "configure";
+    }
+    return "unknown";
+}
+
+const char* StageStats::name(Counter counter)
+{
+    switch (counter) {
+        case Counter::METRICS_READ:
+            return "metrics_read";
+        case Counter::METRICS_PROCESSED:
+            return "metrics_processed";
+        case Counter::DB_QUERIES:
+            return "db_queries";
+    }
+    return "unknown";
+}
+
+const char* StageStats::name(Age age)
+{
+    switch (age) {
+        case Age::PUBLISH_LAG:
+            return "publish_lag";
+        case Age::INPUT_AGE:
+            return "input_age";
+    }
+    return "unknown";
+}
+
+uint32_t StageStats::samplingPeriod(Stage stage)
+{
+    // stages taking less than ~1 us are sampled, so two clock reads stay far below 1 % of the work
+    switch (stage) {
+        case Stage::PARSE:
+        case Stage::ADVERTISE:
+            return 64;
+        case Stage::CALCULATE:
+            return 16;
+        default:
+            return 1;
+    }
+}
+
+bool StageTimer::sampled(Stage stage)
+{
+    static thread_local uint32_t calls[STAGE_COUNT] = {};
+
+    uint32_t period = StageStats::samplingPeriod(stage);
+    return (period <= 1) || ((calls[size_t(stage)]++ % period) == 0);
+}
+
+std::vector<std::pair<std::string, std::string>> StageStats::report()
+{
+    std::vector<std::pair<std::string, std::string>> result;
+
+    auto us = [](uint64_t ns) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.3f", double(ns) / 1000);
+        return std::string(buffer);
+    };
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        const LatencyHistogram& h    = s_histograms[i];
+        std::string             name = StageStats::name(Stage(i));
+        result.emplace_back(name + ".count", std::to_string(h.count()));
+        result.emplace_back(name + ".mean_us", us(h.mean()));
+        result.emplace_back(name + ".p50_us", us(h.percentile(50)));
+        result.emplace_back(name + ".p90_us", us(h.percentile(90)));
+        result.emplace_back(name + ".p99_us", us(h.percentile(99)));
+        result.emplace_back(name + ".max_us", us(h.max()));
+    }
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        result.emplace_back(name(Counter(i)), std::to_string(s_counters[i].load(std::memory_order_relaxed)));
+    }
+    for (size_t i = 0; i < AGE_COUNT; ++i) {
+        const LatencyHistogram& h      = s_ages[i];
+        std::string             prefix = name(Age(i));
+        result.emplace_back(prefix + ".count", std::to_string(h.count()));
+        result.emplace_back(prefix + ".mean_s", std::to_string(h.mean()));
+        result.emplace_back(prefix + ".p50_s", std::to_string(h.percentile(50)));
+        result.emplace_back(prefix + ".p90_s", std::to_string(h.percentile(90)));
+        result.emplace_back(prefix + ".p99_s", std::to_string(h.percentile(99)));
+        result.emplace_back(prefix + ".max_s", std::to_string(h.max()));
+    }
+    return result;
+}
+
+std::string StageStats::dump()
+{
+    std::string result;
+    char        line[256];
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        const LatencyHistogram& h = s_histograms[i];
+        snprintf(line, sizeof(line),
+            "%-17s count: %" PRIu64 " (1/%u sampled), mean: %.1f us, p50: %.1f us, p90: %.1f us, p99: %.1f us, "
+            "max: %.1f us\n",
+            name(Stage(i)), h.count(), samplingPeriod(Stage(i)), double(h.mean()) / 1000,
+            double(h.percentile(50)) / 1000, double(h.percentile(90)) / 1000, double(h.percentile(99)) / 1000,
+            double(h.max()) / 1000);
+        result += line;
+    }
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        snprintf(line, sizeof(line), "%-17s %" PRIu64 "\n", name(Counter(i)), s_counters[i].load());
+        result += line;
+    }
+    for (size_t i = 0; i < AGE_COUNT; ++i) {
+        const LatencyHistogram& h = s_ages[i];
+        snprintf(line, sizeof(line),
+            "%-17s count: %" PRIu64 ", mean: %" PRIu64 " s, p50: %" PRIu64 " s, p90: %" PRIu64 " s, p99: %" PRIu64
+            " s, max: %" PRIu64 " s\n",
+            name(Age(i)), h.count(), h.mean(), h.percentile(50), h.percentile(90), h.percentile(99), h.max());
+        result += line;
+    }
+    return result;
+}
+
+void StageStats::reset()
+{
+    for (auto& histogram : s_histograms) {
+        histogram.reset();
+    }
+    for (auto& counter : s_counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for (auto& histogram : s_ages) {
+        histogram.reset();
+    }
+}
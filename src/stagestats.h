@@ -0,0 +1,240 @@
+/*  =========================================================================
+    stagestats - Latency histograms and counters of the processing stages
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+/// @file   stagestats.h
+/// @brief  Latency histograms and counters of the processing stages (STATS request, SIGUSR1 dump)
+
+#pragma once
+
+#include "tracer.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// timed stages of the processing cycle
+enum class Stage : uint8_t
+{
+    SHM_READ,     ///< read of metrics from shm (per poll)
+    PARSE,        ///< conversion of a metric value (sampled)
+    CALCULATE,    ///< calculation of totals of a unit (sampled)
+    ADVERTISE,    ///< decision whether to publish a total (sampled)
+    WRITE_METRIC, ///< write of a published metric to shm
+    CONFIGURE,    ///< reload of the topology from the database
+};
+static const size_t STAGE_COUNT = size_t(Stage::CONFIGURE) + 1;
+
+/// counted events
+enum class Counter : uint8_t
+{
+    METRICS_READ,      ///< metrics read from shm
+    METRICS_PROCESSED, ///< metrics feeding some unit
+    DB_QUERIES,        ///< queries of the database
+};
+static const size_t COUNTER_COUNT = size_t(Counter::DB_QUERIES) + 1;
+
+/// age of the measurements behind published totals
+enum class Age : uint8_t
+{
+    PUBLISH_LAG, ///< from the newest input to the publishing
+    INPUT_AGE,   ///< from the oldest input to the publishing
+};
+static const size_t AGE_COUNT = size_t(Age::INPUT_AGE) + 1;
+
+/// HDR-style histogram of durations [ns]
+///
+/// Values below 16 ns have own buckets, each power of 2 above is split into 16 buckets,
+/// so the value of a bucket is exact within 1/16 (6.25 %). Recording is lock free.
+class LatencyHistogram
+{
+public:
+    /// significant bits of a value (16 buckets per power of 2)
+    static constexpr unsigned SUB_BITS = 4;
+    /// values above 2^MAX_BITS ns (18 minutes) are counted as the biggest value
+    static constexpr unsigned MAX_BITS = 40;
+    static constexpr size_t   BUCKETS  = (1u << SUB_BITS) * (MAX_BITS - SUB_BITS + 1);
+
+    void record(uint64_t ns)
+    {
+        _buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t max = _max.load(std::memory_order_relaxed);
+        while ((ns > max) && !_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+        }
+    };
+
+    uint64_t count() const
+    {
+        return _count.load(std::memory_order_relaxed);
+    };
+    /// mean duration [ns], 0 if empty
+    uint64_t mean() const;
+    uint64_t max() const
+    {
+        return _max.load(std::memory_order_relaxed);
+    };
+    /// the duration not exceeded by the percent of values [ns] (upper bound of its bucket), 0 if empty
+    uint64_t percentile(double percent) const;
+
+    void reset();
+
+    /// index of the bucket of the value
+    static size_t bucket(uint64_t ns)
+    {
+        if (ns < (1u << SUB_BITS)) {
+            return size_t(ns);
+        }
+        if (ns >= (uint64_t(1) << MAX_BITS)) {
+            ns = (uint64_t(1) << MAX_BITS) - 1;
+        }
+        unsigned exponent = 63 - unsigned(__builtin_clzll(ns)); // >= SUB_BITS
+        unsigned shift    = exponent - SUB_BITS;
+        return (size_t(shift + 1) << SUB_BITS) + size_t((ns >> shift) & ((1u << SUB_BITS) - 1));
+    };
+    /// the biggest value of the bucket
+    static uint64_t bucketMax(size_t index);
+
+private:
+    std::atomic<uint64_t> _buckets[BUCKETS] = {};
+    std::atomic<uint64_t> _count{0};
+    std::atomic<uint64_t> _sum{0};
+    std::atomic<uint64_t> _max{0};
+};
+
+/// Histograms of stages and counters of the process
+class StageStats
+{
+public:
+    /// measure stages (counters are counted always)
+    static void enable(bool enabled)
+    {
+        s_enabled.store(enabled, std::memory_order_relaxed);
+    };
+    static bool enabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    };
+
+    /// record duration of the stage [ns]
+    static void record(Stage stage, uint64_t ns)
+    {
+        s_histograms[size_t(stage)].record(ns);
+    };
+    /// record age of a published total [s]
+    static void record(Age age, uint64_t seconds)
+    {
+        s_ages[size_t(age)].record(seconds);
+    };
+    static void count(Counter counter, uint64_t n = 1)
+    {
+        s_counters[size_t(counter)].fetch_add(n, std::memory_order_relaxed);
+    };
+
+    static const LatencyHistogram& histogram(Stage stage)
+    {
+        return s_histograms[size_t(stage)];
+    };
+    /// histogram of ages [s]
+    static const LatencyHistogram& histogram(Age age)
+    {
+        return s_ages[size_t(age)];
+    };
+    static uint64_t counter(Counter counter)
+    {
+        return s_counters[size_t(counter)].load(std::memory_order_relaxed);
+    };
+
+    /// 'shm_read', 'db_queries', ...
+    static const char* name(Stage stage);
+    static const char* name(Counter counter);
+    static const char* name(Age age);
+
+    /// the stages timed once per N calls (the other stages are timed always)
+    static uint32_t samplingPeriod(Stage stage);
+
+    /// statistics as (name, value) pairs: '<stage>.count', '<stage>.p99_us', ..., '<counter>', '<age>.p99_s', ...
+    static std::vector<std::pair<std::string, std::string>> report();
+    /// report on one line per stage (SIGUSR1 dump)
+    static std::string dump();
+
+    /// clear all histograms and counters
+    static void reset();
+
+private:
+    static std::atomic<bool>     s_enabled;
+    static LatencyHistogram      s_histograms[STAGE_COUNT];
+    static LatencyHistogram      s_ages[AGE_COUNT];
+    static std::atomic<uint64_t> s_counters[COUNTER_COUNT];
+};
+
+/// Measures duration of the scope and records it to the stage
+///
+/// Sampled stages read the clock only once per sampling period of the thread,
+/// the other calls cost an increment of a thread local counter. When the tracer
+/// is enabled, every call is recorded as a span of the trace too.
+class StageTimer
+{
+public:
+    /// @param detail - argument of the trace span (unit, asset), must outlive the timer
+    explicit StageTimer(Stage stage, const char* detail = nullptr)
+        : _stage(stage)
+        , _detail(detail)
+    {
+        _sampled = StageStats::enabled() && sampled(stage);
+        _traced  = Tracer::enabled();
+        if (_sampled || _traced) {
+            _start = Tracer::now();
+        }
+    };
+    ~StageTimer()
+    {
+        stop();
+    };
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    /// record the duration now instead of at the end of the scope
+    void stop()
+    {
+        if (_sampled || _traced) {
+            uint64_t end = Tracer::now();
+            if (_sampled) {
+                StageStats::record(_stage, end - _start);
+            }
+            if (_traced) {
+                Tracer::record(StageStats::name(_stage), "stage", _start, end, _detail);
+            }
+            _sampled = _traced = false;
+        }
+    };
+
+private:
+    Stage       _stage;
+    const char* _detail;
+    bool        _sampled = false;
+    bool        _traced  = false;
+    uint64_t    _start   = 0; ///< [ns]
+
+    static bool sampled(Stage stage);
+};
@@ -19,9 +19,14 @@
  */
 
 #include "tp_unit.h"
+#include "clock.h"
+#include "probes.h"
+#include "stagestats.h"
 #include "tpowerconfiguration.h"
+#include <algorithm>
+#include <array>
+#include <cinttypes>
 #include <cmath>
-#include <ctime>
 #include <exception>
 #include <fty_log.h>
 #include <stdexcept>
@@ -31,314 +36,631 @@
 #define ANSI_COLOR_LIGHTMAGENTA "\x1b[1;95m"
 #define ANSI_COLOR_RESET        "\x1b[0m"
 
-enum TPowerMethod
+double TPUnit::get(Quantity quantity) const
 {
-    TPOWER_REALPOWER_UNDEFINED = 0,
-    TPOWER_REALPOWER_DEFAULT   = 1,
-    TPOWER_REALPOWER_OUTPUT_L1 = 2,
-    TPOWER_REALPOWER_OUTPUT_L2 = 3,
-    TPOWER_REALPOWER_OUTPUT_L3 = 4,
-};
-
-const std::map<std::string, int> TPUnit::_calculations = {
-    {"realpower.default", TPOWER_REALPOWER_DEFAULT},
-    {"realpower.output.L1", TPOWER_REALPOWER_OUTPUT_L1},
-    {"realpower.output.L2", TPOWER_REALPOWER_OUTPUT_L2},
-    {"realpower.output.L3", TPOWER_REALPOWER_OUTPUT_L3},
-};
-
-double TPUnit::get(const std::string& quantity) const
-{
-    double result = _lastValue.find(quantity);
-    if (std::isnan(result)) {
+    if (quantityIsUnknown(quantity)) {
         throw std::runtime_error("Unknown quantity (" + generateTopic(quantity) + ")");
     }
-    return result;
+    return state(quantity).lastValue.value;
 }
 
-MetricInfo TPUnit::getMetricInfo(const std::string& quantity) const
+const MetricInfo& TPUnit::getMetricInfo(Quantity quantity)
 {
-    auto result = _lastValue.getMetricInfo(generateTopic(quantity));
-    if (result.isUnknown()) {
+    if (quantityIsUnknown(quantity)) {
         throw std::runtime_error("Unknown quantity");
     }
-    return result;
+    // update in place, the names don't change
+    auto& total = state(quantity);
+    total.published.setValue(total.lastValue.value);
+    total.published.setTimestamp(total.lastValue.getTimestamp());
+    total.published.setTtl(total.lastValue.ttl);
+    return total.published;
 }
 
-void TPUnit::set(const std::string& quantity, const MetricInfo& measurement)
+void TPUnit::name(const std::string& name)
 {
-    double currentValue = _lastValue.find(generateTopic(quantity));
+    _name   = name;
+    _nameId = NameRegistry::elements().intern(_name);
 
-    if (std::isnan(currentValue) || (abs(currentValue - measurement.getValue()) > 0.00001)) {
-        _lastValue.addMetricInfo(measurement);
-        _changed[quantity]         = true;
-        _changetimestamp[quantity] = measurement.getTimestamp();
+    // build published metrics now, so publishing doesn't allocate
+    for (size_t q = 0; q < QUANTITY_COUNT; ++q) {
+        _quantities[q].published =
+            MetricInfo(_name, quantity::name(Quantity(q)), quantity::units(Quantity(q)), std::nan(""), 0, TTL);
     }
+    _energyPublished      = MetricInfo(_name, "energy.default", "kWh", std::nan(""), 0, TTL);
+    _oldestInputPublished = MetricInfo(_name, "realpower.default.oldest_input", "s", std::nan(""), 0, TTL);
 }
 
-MetricInfo TPUnit::simpleSummarize(const std::string& quantity) const
+const TPowerSettings& TPUnit::settings() const
 {
-    log_trace("simpleSummarize %s", generateTopic(quantity).c_str());
+    static const TPowerSettings defaultSettings;
+    return _settings ? *_settings : defaultSettings;
+}
 
-    double sum = 0;
-    for (const auto& it : _powerdevices) // std::map< std::string, MetricList> it
-    {
-        double value = getMetricValue(it.second, quantity, it.first);
-        if (std::isnan(value)) {
-            log_debug(ANSI_COLOR_LIGHTMAGENTA "%s@%s is NAN" ANSI_COLOR_RESET, quantity.c_str(), it.first.c_str());
+void TPUnit::set(Quantity quantity, const Measurement& measurement)
+{
+    auto& total = state(quantity);
+    total.current = measurement.value;
+
+    if ((quantity == Quantity::REALPOWER_DEFAULT) && !std::isnan(measurement.value)) {
+        // every calculated total, deadband doesn't apply
+        updateWindows();
+        for (auto& window : _windows) {
+            window.add(measurement.getTimestamp(), measurement.value);
+        }
+        integrate(measurement.getTimestamp(), measurement.value);
+    }
 
-            throw std::runtime_error(quantity + "@" + it.first + " is missing");
-        } else {
-            sum += value;
+    if (quantityIsUnknown(quantity) ||
+        settings().deadband(quantity).exceeded(total.lastValue.value, measurement.value)) {
+        total.lastValue       = measurement;
+        total.changed         = true;
+        total.changeTimestamp = measurement.getTimestamp();
+    } else {
+        // the reported value is still valid, don't let it expire
+        if (total.lastValue.value != measurement.value) {
+            _deadbandSuppressed++;
         }
+        total.lastValue.timestamp = measurement.timestamp;
+        total.lastValue.ttl       = measurement.ttl;
     }
+}
 
-    MetricInfo result(_name, quantity, "W", sum, uint64_t(::time(NULL)), TTL);
-    return result;
+void TPUnit::updateWindows()
+{
+    const auto& windows   = settings().statisticWindows;
+    bool        staleness = settings().stalenessStatistics;
+    if ((windows == _windowSeconds) && (staleness == _stalenessWindows)) {
+        return;
+    }
+    _windowSeconds    = windows;
+    _stalenessWindows = staleness;
+    _windows.clear();
+    _staleness.clear();
+    _statistics.clear();
+    std::string prefix = std::string(quantity::name(Quantity::REALPOWER_DEFAULT)) + ".";
+    for (auto seconds : windows) {
+        _windows.emplace_back(seconds);
+        for (const char* stat : {"avg_", "min_", "max_"}) {
+            std::string source = prefix + stat + _windows.back().name();
+            _statistics.emplace_back(_name, source, "W", std::nan(""), 0, uint64_t(TTL));
+        }
+    }
+    if (!staleness) {
+        return;
+    }
+    for (const auto& window : _windows) {
+        _staleness.push_back({RollingWindow(window.seconds()), RollingWindow(window.seconds())});
+        for (const char* stat : {"publish_lag.avg_", "publish_lag.max_", "input_age.avg_", "input_age.max_"}) {
+            std::string source = prefix + stat + window.name();
+            _statistics.emplace_back(_name, source, "s", std::nan(""), 0, uint64_t(TTL));
+        }
+    }
 }
 
-MetricInfo TPUnit::realpowerDefault(const std::string& quantity) const
+const std::vector<MetricInfo>& TPUnit::statistics(uint64_t now)
 {
-    std::string topic = generateTopic(quantity);
-    log_trace("realpowerDefault %s", topic.c_str());
+    updateWindows();
+    for (size_t i = 0; i < _windows.size(); ++i) {
+        auto stats = _windows[i].stats(now);
+        _statistics[3 * i].setValue(stats.average);
+        _statistics[3 * i + 1].setValue(stats.minimum);
+        _statistics[3 * i + 2].setValue(stats.maximum);
+    }
+    for (size_t i = 0; i < _staleness.size(); ++i) {
+        size_t first = 3 * _windows.size() + 4 * i;
+        auto   lag   = _staleness[i].publishLag.stats(now);
+        auto   age   = _staleness[i].inputAge.stats(now);
+        _statistics[first].setValue(lag.average);
+        _statistics[first + 1].setValue(lag.maximum);
+        _statistics[first + 2].setValue(age.average);
+        _statistics[first + 3].setValue(age.maximum);
+    }
+    for (auto& metric : _statistics) {
+        metric.setTimestamp(now);
+    }
+    return _statistics;
+}
 
-    double sum = 0;
-    for (const auto& it : _powerdevices) {
-        double value = getMetricValue(it.second, quantity, it.first);
-        if (std::isnan(value)) {
-            // ZZZ continue; // ignore NAN values
+void TPUnit::integrate(uint64_t timestamp, double power)
+{
+    auto& counter = _energy;
+    if (!std::isnan(counter.lastPower) && (timestamp == counter.lastTimestamp)) {
+        // recalculated within the same second, the area is added with the next total
+        counter.lastPower = power;
+        return;
+    }
+    if (!std::isnan(counter.lastPower) && (timestamp > counter.lastTimestamp) &&
+        (timestamp - counter.lastTimestamp <= TTL)) {
+        double area = (counter.lastPower + power) / 2 * double(timestamp - counter.lastTimestamp) / 3600;
+        // the counter is monotonic
+        counter.energy += std::max(0.0, area);
+    } else if (!std::isnan(counter.lastPower)) {
+        log_debug("energy.default@%s integration restarted (gap %" PRIi64 "s)", _name.c_str(),
+            int64_t(timestamp) - int64_t(counter.lastTimestamp));
+    }
+    counter.lastPower     = power;
+    counter.lastTimestamp = timestamp;
+}
 
-            // realpower.default not present, try to sum the phases
-            log_debug(ANSI_COLOR_LIGHTMAGENTA "%s calculation: %s@%s is NAN" ANSI_COLOR_RESET, topic.c_str(),
-                quantity.c_str(), it.first.c_str());
+void TPUnit::unknown(Quantity quantity)
+{
+    state(quantity).current = std::nan("");
+    state(quantity).inputs  = InputSpan();
+    if (quantity == Quantity::REALPOWER_DEFAULT) {
+        // the power between the last known total and the next one is unknown
+        _energy.lastPower = std::nan("");
+    }
+}
 
-            for (int phase = 1; phase <= 3; ++phase) {
-                const std::string quant = "realpower.output.L" + std::to_string(phase);
-                value                   = getMetricValue(it.second, quant, it.first);
-                if (std::isnan(value)) {
-                    log_debug(ANSI_COLOR_LIGHTMAGENTA "%s calculation: %s@%s is NAN" ANSI_COLOR_RESET, topic.c_str(),
-                        quant.c_str(), it.first.c_str());
+const MetricInfo& TPUnit::energyMetric(uint64_t now)
+{
+    _energyPublished.setValue(_energy.energy / 1000);
+    _energyPublished.setTimestamp(now);
+    return _energyPublished;
+}
 
-                    throw std::runtime_error(quant + "@" + it.first + " is missing");
-                }
-                sum += value;
+const MetricInfo& TPUnit::oldestInputMetric(uint64_t now)
+{
+    const auto& inputs = state(Quantity::REALPOWER_DEFAULT).inputs;
+    _oldestInputPublished.setValue(inputs.empty() ? std::nan("") : double(inputs.oldestTimestamp()));
+    _oldestInputPublished.setTimestamp(now);
+    return _oldestInputPublished;
+}
+
+namespace {
+
+/// rack: realpower.default only
+struct RackKernel
+{
+    static constexpr size_t totals = size_t(Quantity::REALPOWER_DEFAULT) + 1;
+};
+
+/// DC: all realpower totals, apparent power of input phases and their imbalance
+struct DCKernel
+{
+    static constexpr size_t totals = size_t(Quantity::POWER_INPUT_IMBALANCE) + 1;
+};
+
+static_assert(DCKernel::totals <= QUANTITY_COUNT, "DCKernel computes totals of known quantities");
+
+/// one total being summed
+struct FusedSum
+{
+    double      sum     = 0;
+    const char* missing = nullptr; // first device without the measurement
+    InputSpan   inputs;            // timestamps of the summed measurements
+
+    /// add value computed from the inputs
+    void add(double value, const std::string& device, const InputSpan& span)
+    {
+        if (std::isnan(value)) {
+            if (!missing) {
+                missing = device.c_str();
             }
         } else {
             sum += value;
+            inputs.add(span);
+        }
+    }
+    void add(const Measurement& measurement, const std::string& device)
+    {
+        if (std::isnan(measurement.value)) {
+            if (!missing) {
+                missing = device.c_str();
+            }
+        } else {
+            sum += measurement.value;
+            inputs.add(measurement);
         }
     }
+};
 
-    MetricInfo result(_name, quantity, "W", sum, uint64_t(::time(NULL)), TTL);
+const Quantity inputQuantities[3]    = {Quantity::REALPOWER_INPUT_L1, Quantity::REALPOWER_INPUT_L2,
+    Quantity::REALPOWER_INPUT_L3};
+const Quantity outputQuantities[3]   = {Quantity::REALPOWER_OUTPUT_L1, Quantity::REALPOWER_OUTPUT_L2,
+    Quantity::REALPOWER_OUTPUT_L3};
+const Quantity apparentQuantities[3] = {Quantity::POWER_INPUT_L1, Quantity::POWER_INPUT_L2,
+    Quantity::POWER_INPUT_L3};
+const Quantity currentQuantities[3]  = {Quantity::CURRENT_INPUT_L1, Quantity::CURRENT_INPUT_L2,
+    Quantity::CURRENT_INPUT_L3};
+const Quantity voltageQuantities[3]  = {Quantity::VOLTAGE_INPUT_L1, Quantity::VOLTAGE_INPUT_L2,
+    Quantity::VOLTAGE_INPUT_L3};
+
+/// imbalance of phases: max deviation from the average [%]
+FusedSum imbalance(const FusedSum (&phases)[3])
+{
+    FusedSum result;
+    double   average = 0;
+    for (const auto& phase : phases) {
+        if (phase.missing) {
+            result.missing = phase.missing;
+            return result;
+        }
+        average += phase.sum / 3;
+        result.inputs.add(phase.inputs);
+    }
+    if (average > 0) {
+        for (const auto& phase : phases) {
+            result.sum = std::max(result.sum, std::fabs(phase.sum - average) / average * 100);
+        }
+    }
     return result;
 }
 
-MetricInfo TPUnit::realpowerOutput(const std::string& quantity) const
+} // namespace
+
+template <class Kernel>
+void TPUnit::calculateFused(const Quantity* first, const Quantity* last)
 {
-    std::string topic = generateTopic(quantity);
-    log_trace("realpowerOutput %s", topic.c_str());
+    constexpr bool withPhases   = Kernel::totals > size_t(Quantity::REALPOWER_OUTPUT_L1);
+    constexpr bool withApparent = Kernel::totals > size_t(Quantity::POWER_INPUT_IMBALANCE);
 
-    double sum    = 0;
-    int    devCnt = 0;
-    int    phases = 0;
+    std::array<FusedSum, Kernel::totals> totals;
+
+    int devCnt = 0;
 
     for (const auto& it : _powerdevices) {
-        double value = getMetricValue(it.second, quantity, it.first);
-        if (std::isnan(value)) {
-            throw std::runtime_error(quantity + "@" + it.first + " is missing");
+        const auto& measurements = it.second.measurements;
+        const auto& device       = it.first;
+
+        const Measurement* output[3] = {nullptr, nullptr, nullptr};
+        auto               getOutput = [&]() {
+            for (int phase = 0; phase < 3; ++phase) {
+                output[phase] = &measurements.getMeasurement(outputQuantities[phase]);
+            }
+        };
+        if constexpr (withPhases) {
+            getOutput();
         }
 
-        // detect a mix of single, bi and three phases devices
-        if (phases == 0) { // first time
-            double roL3 = getMetricValue(it.second, "realpower.output.L3", it.first);
-            if (std::isnan(roL3)) {
-                double roL2 = getMetricValue(it.second, "realpower.output.L2", it.first);
-                if (std::isnan(roL2))
-                    phases = 1; // 1-phase
-                else
-                    phases = 2; // 2-phase
-            } else
-                phases = 3; // 3-phase
-
-            log_debug("%s calculation: choose %d phases output (%s@%s)", topic.c_str(), phases, quantity.c_str(),
-                it.first.c_str());
+        const Measurement& realpower = measurements.getMeasurement(Quantity::REALPOWER_DEFAULT);
+        if (!std::isnan(realpower.value)) {
+            totals[size_t(Quantity::REALPOWER_DEFAULT)].add(realpower, device);
         } else {
-            bool mixedPhaseOuput = false;
-            switch (phases) {
-                case 1: { // 1-phase
-                    double roL2 = getMetricValue(it.second, "realpower.output.L2", it.first);
-                    if (!std::isnan(roL2))
-                        mixedPhaseOuput = true;
-                    break;
-                }
-                case 2: { // 2-phase
-                    double roL3 = getMetricValue(it.second, "realpower.output.L3", it.first);
-                    if (!std::isnan(roL3))
-                        mixedPhaseOuput = true;
-                    break;
-                }
-                case 3: // 3-phase
-                default: {
-                    double roL3 = getMetricValue(it.second, "realpower.output.L3", it.first);
-                    if (std::isnan(roL3))
-                        mixedPhaseOuput = true;
-                    break;
+            // realpower.default not present, try to sum the phases
+            if constexpr (!withPhases) {
+                getOutput();
+            }
+            InputSpan span;
+            for (const auto* phase : output) {
+                span.add(*phase);
+            }
+            totals[size_t(Quantity::REALPOWER_DEFAULT)].add(
+                output[0]->value + output[1]->value + output[2]->value, device, span);
+        }
+
+        if constexpr (withPhases) {
+            for (int phase = 0; phase < 3; ++phase) {
+                totals[size_t(inputQuantities[phase])].add(measurements.getMeasurement(inputQuantities[phase]), device);
+                totals[size_t(outputQuantities[phase])].add(*output[phase], device);
+            }
+        }
+        if constexpr (withApparent) {
+            for (int phase = 0; phase < 3; ++phase) {
+                // measured apparent power, or V x I
+                const Measurement& apparent = measurements.getMeasurement(apparentQuantities[phase]);
+                if (!std::isnan(apparent.value)) {
+                    totals[size_t(apparentQuantities[phase])].add(apparent, device);
+                    continue;
                 }
+                const Measurement& voltage = measurements.getMeasurement(voltageQuantities[phase]);
+                const Measurement& current = measurements.getMeasurement(currentQuantities[phase]);
+                InputSpan          span;
+                span.add(voltage);
+                span.add(current);
+                totals[size_t(apparentQuantities[phase])].add(voltage.value * current.value, device, span);
             }
+        }
+        devCnt++;
+    }
+    if constexpr (withApparent) {
+        const FusedSum phases[3] = {totals[size_t(Quantity::POWER_INPUT_L1)],
+            totals[size_t(Quantity::POWER_INPUT_L2)], totals[size_t(Quantity::POWER_INPUT_L3)]};
+        totals[size_t(Quantity::POWER_INPUT_IMBALANCE)] = imbalance(phases);
+    }
 
-            if (mixedPhaseOuput) {
-                log_debug(ANSI_COLOR_LIGHTMAGENTA
-                    "%s calculation: avoid mixed phases (%s@%s, phases: %d)" ANSI_COLOR_RESET,
-                    topic.c_str(), quantity.c_str(), it.first.c_str(), phases);
+    uint64_t now = Clock::now();
+    for (auto it = first; it != last; ++it) {
+        Quantity quantity = *it;
+        if ((quantity::mask(quantity) & _rollupMask) != 0) {
+            calculateRollup(quantity, now);
+            continue;
+        }
+        if (size_t(quantity) >= Kernel::totals) {
+            if (size_t(quantity) < DCKernel::totals) {
+                // computed by a bigger kernel, within this calculation
+                calculateFused<DCKernel>(&quantity, &quantity + 1);
+            }
+            continue;
+        }
 
-                throw std::runtime_error(
-                    "avoid mixed phases output (phases: " + std::to_string(phases) + ", device: " + it.first + ")");
+        const char* name   = quantity::name(quantity);
+        const auto& result = totals[size_t(quantity)];
+        if (result.missing) {
+            log_debug(ANSI_COLOR_RED "%s@%s calculate failed (%s@%s is missing)" ANSI_COLOR_RESET, name,
+                _name.c_str(), name, result.missing);
+            unknown(quantity);
+            continue;
+        }
+
+        double value = result.sum;
+        if ((quantity >= Quantity::REALPOWER_OUTPUT_L1) && (quantity <= Quantity::REALPOWER_OUTPUT_L3)) {
+            if (mixedPhases()) {
+                log_debug(ANSI_COLOR_RED "%s@%s calculate failed (avoid mixed phases output, phases: %d)"
+                                         ANSI_COLOR_RESET,
+                    name, _name.c_str(), _powerdevices.begin()->second.phases);
+                unknown(quantity);
+                continue;
+            }
+            if (devCnt == 0) {
+                value = std::nan("");
             }
         }
 
-        devCnt++;
-        sum += value;
+        set(quantity, total(quantity, value, now));
+        state(quantity).inputs = result.inputs;
+        log_trace("%s@%s calculate " ANSI_COLOR_BOLD "succeeded" ANSI_COLOR_RESET, name, _name.c_str());
     }
-
-    return MetricInfo(_name, quantity, "W", ((devCnt > 0) ? sum : std::nan("")), uint64_t(::time(NULL)), TTL);
 }
 
-void TPUnit::calculate(const std::string& quantity)
+void TPUnit::calculateRollup(Quantity quantity, uint64_t now)
 {
-    const std::string topic = generateTopic(quantity);
-    log_trace(ANSI_COLOR_BOLD "%s calculate" ANSI_COLOR_RESET, topic.c_str());
-
-    try {
-        const auto it         = _calculations.find(quantity);
-        int        calcMethod = (it != _calculations.cend()) ? it->second : TPOWER_REALPOWER_UNDEFINED;
-
-        MetricInfo result;
-        switch (calcMethod) {
-            case TPOWER_REALPOWER_DEFAULT:
-                result = realpowerDefault(quantity);
-                break;
-            case TPOWER_REALPOWER_OUTPUT_L1:
-            case TPOWER_REALPOWER_OUTPUT_L2:
-            case TPOWER_REALPOWER_OUTPUT_L3:
-                result = realpowerOutput(quantity);
-                break;
-            case TPOWER_REALPOWER_UNDEFINED:
-            default:
-                result = simpleSummarize(quantity);
-                break;
+    const char* name = quantity::name(quantity);
+    double      sum  = 0;
+    InputSpan   inputs;
+    for (const TPUnit* child : _children) {
+        const auto& childState = child->state(quantity);
+        if (std::isnan(childState.current)) {
+            log_debug(ANSI_COLOR_RED "%s@%s calculate failed (%s@%s is unknown)" ANSI_COLOR_RESET, name,
+                _name.c_str(), name, child->name().c_str());
+            unknown(quantity);
+            return;
         }
+        sum += childState.current;
+        inputs.add(childState.inputs);
+    }
 
-        set(quantity, result);
+    set(quantity, total(quantity, sum, now));
+    state(quantity).inputs = inputs;
+    log_trace("%s@%s roll-up " ANSI_COLOR_BOLD "succeeded" ANSI_COLOR_RESET, name, _name.c_str());
+}
+
+void TPUnit::calculate(Quantity quantity)
+{
+    log_trace(ANSI_COLOR_BOLD "%s@%s calculate" ANSI_COLOR_RESET, quantity::name(quantity), _name.c_str());
+    _calculations++;
+    StageTimer timer(Stage::CALCULATE, _name.c_str());
+    TPOWER_PROBE3(calculate__start, _name.c_str(), int(quantity), 1);
+
+    // the cheapest kernel computing the quantity
+    if ((quantity::mask(quantity) & _rollupMask) != 0) {
+        calculateRollup(quantity, Clock::now());
+    } else if (size_t(quantity) < RackKernel::totals) {
+        calculateFused<RackKernel>(&quantity, &quantity + 1);
+    } else {
+        calculateFused<DCKernel>(&quantity, &quantity + 1);
+    }
+    TPOWER_PROBE3(calculate__done, _name.c_str(), int(quantity), int(!std::isnan(current(quantity))));
+}
 
-        log_trace("%s calculate " ANSI_COLOR_BOLD "succeeded" ANSI_COLOR_RESET, topic.c_str());
-    } catch (std::exception& e) {
-        log_debug(ANSI_COLOR_RED "%s calculate failed on exception (%s)" ANSI_COLOR_RESET, topic.c_str(), e.what());
-    } catch (...) {
-        log_debug(ANSI_COLOR_RED "%s calculate failed" ANSI_COLOR_RESET, topic.c_str());
+void TPUnit::calculate(Quantity first, Quantity second)
+{
+    const Quantity quantities[2] = {first, second};
+    _calculations++;
+    StageTimer timer(Stage::CALCULATE, _name.c_str());
+    TPOWER_PROBE3(calculate__start, _name.c_str(), int(first), 2);
+    if (std::max(size_t(first), size_t(second)) < RackKernel::totals) {
+        calculateFused<RackKernel>(quantities, quantities + 2);
+    } else {
+        calculateFused<DCKernel>(quantities, quantities + 2);
     }
+    TPOWER_PROBE3(calculate__done, _name.c_str(), int(first), int(!std::isnan(current(first))));
 }
 
-void TPUnit::calculate(const std::vector<std::string>& quantities)
+void TPUnit::calculate(const std::vector<Quantity>& quantities)
 {
+    _dirty = false;
     dropOldMetricInfos();
-    for (const auto& it : quantities) {
-        calculate(it);
+    _calculations++;
+    StageTimer timer(Stage::CALCULATE, _name.c_str());
+    // probes report the first quantity (realpower.default)
+    Quantity first = quantities.empty() ? Quantity::REALPOWER_DEFAULT : quantities.front();
+    TPOWER_PROBE3(calculate__start, _name.c_str(), int(first), int(quantities.size()));
+
+    uint32_t direct = 0;
+    for (auto quantity : quantities) {
+        direct |= quantity::mask(quantity) & ~_rollupMask;
+    }
+    if (direct == 0) {
+        // all totals are summed from the children, devices are not needed
+        uint64_t now = Clock::now();
+        for (auto quantity : quantities) {
+            calculateRollup(quantity, now);
+        }
+    } else if (_kind == TPUnitKind::DC) {
+        calculateFused<DCKernel>(quantities.data(), quantities.data() + quantities.size());
+    } else {
+        // racks, rows, rooms and groups
+        calculateFused<RackKernel>(quantities.data(), quantities.data() + quantities.size());
     }
+    TPOWER_PROBE3(calculate__done, _name.c_str(), int(first), int(!std::isnan(current(first))));
 }
 
-double TPUnit::getMetricValue(
-    const MetricList& measurements, const std::string& quantity, const std::string& deviceName) const
+Measurement TPUnit::total(Quantity quantity, double value, uint64_t timestamp) const
 {
-    std::string topic = quantity + "@" + deviceName;
-    return measurements.find(topic);
+    static const auto unitsIds = []() {
+        std::array<uint16_t, QUANTITY_COUNT> result;
+        for (size_t q = 0; q < QUANTITY_COUNT; ++q) {
+            result[q] = uint16_t(NameRegistry::units().intern(quantity::units(Quantity(q))));
+        }
+        return result;
+    }();
+    return Measurement(quantity, _nameId, unitsIds[size_t(quantity)], value, timestamp, TTL);
 }
 
 // TODO setup max life time metric
 void TPUnit::dropOldMetricInfos()
 {
     for (auto& device : _powerdevices) {
-        auto& measurements = device.second;
-        measurements.removeOldMetrics();
+        auto& measurements = device.second.measurements;
+        if (measurements.removeOldMetrics() > 0) {
+            updatePhases(device.second);
+        }
+    }
+
+    uint64_t now = Clock::now();
+    for (size_t q = 0; q < QUANTITY_COUNT; ++q) {
+        auto& total = _quantities[q];
+        if (!total.lastValue.isUnknown() && total.lastValue.expired(now)) {
+            total.lastValue = Measurement();
+            unknown(Quantity(q));
+        }
     }
-    _lastValue.removeOldMetrics();
 }
 
-std::string TPUnit::generateTopic(const std::string& quantity) const
+std::string TPUnit::generateTopic(Quantity quantity) const
 {
-    return quantity + "@" + _name;
+    return std::string(quantity::name(quantity)) + "@" + _name;
 }
 
-bool TPUnit::quantityIsUnknown(const std::string& topic) const
+bool TPUnit::quantityIsUnknown(Quantity quantity) const
 {
-    return std::isnan(_lastValue.find(topic));
+    const auto& lastValue = state(quantity).lastValue;
+    return lastValue.isUnknown() || std::isnan(lastValue.value);
 }
 
-std::vector<std::string> TPUnit::devicesInUnknownState(const std::string& quantity) const
+std::vector<std::string> TPUnit::devicesInUnknownState(Quantity quantity) const
 {
     std::vector<std::string> result;
 
-    if (quantityIsKnown(generateTopic(quantity))) {
+    if (quantityIsKnown(quantity)) {
         return result; // empty vector
     }
 
-    uint64_t now = uint64_t(::time(NULL));
+    if ((quantity::mask(quantity) & _rollupMask) != 0) {
+        // rolled-up total waits for the children
+        for (const TPUnit* child : _children) {
+            if (std::isnan(child->state(quantity).current)) {
+                result.push_back(child->name());
+            }
+        }
+        return result;
+    }
+
+    uint64_t now = Clock::now();
     for (const auto& device : _powerdevices) {
-        const auto& deviceMetrics = device.second; // TPUnit
-        std::string topic         = quantity + "@" + device.first;
-        auto        measurement   = deviceMetrics.getMetricInfo(topic);
-        if ((std::isnan(measurement.getValue())) || ((now - measurement.getTimestamp()) > (measurement.getTtl() * 2))) {
+        const auto& measurement = device.second.measurements.getMeasurement(quantity);
+        if ((std::isnan(measurement.value)) || ((now - measurement.getTimestamp()) > (uint64_t(measurement.ttl) * 2))) {
             result.push_back(device.first);
         }
     }
     return result;
 }
 
+void TPUnit::addChild(TPUnit* child)
+{
+    _children.push_back(child);
+    child->_parents.push_back(this);
+}
+
 void TPUnit::addPowerDevice(const std::string& device)
 {
+    auto it = _powerdevices.find(device);
+    if (it != _powerdevices.end()) {
+        _phaseCounts[size_t(it->second.phases)]--;
+    }
     _powerdevices[device] = {};
+    _phaseCounts[1]++;
 }
 
 void TPUnit::setMeasurement(const MetricInfo& M)
 {
-    auto device = _powerdevices.find(M.getElementName());
-    if (device != _powerdevices.end()) // std::map< std::string, MetricList> device
-        device->second.addMetricInfo(M);
+    Quantity quantity = quantity::fromString(M.getSource());
+    if (quantity != Quantity::UNKNOWN) {
+        setMeasurement(M.getElementName(), Measurement::fromMetricInfo(quantity, M));
+    }
+}
+
+void TPUnit::setMeasurement(std::string_view deviceName, const Measurement& measurement)
+{
+    auto device = _powerdevices.find(deviceName);
+    if (device != _powerdevices.end()) { // std::map< std::string, PowerDevice> device
+        auto&    measurements = device->second.measurements;
+        Quantity quantity     = measurement.quantity;
+        // phases can change only when realpower.output.L2/L3 appears
+        bool reclassify = (quantity == Quantity::REALPOWER_OUTPUT_L2 || quantity == Quantity::REALPOWER_OUTPUT_L3) &&
+                          std::isnan(measurements.find(quantity));
+        measurements.addMeasurement(measurement);
+        if (reclassify) {
+            updatePhases(device->second);
+        }
+    }
+}
+
+void TPUnit::updatePhases(PowerDevice& device)
+{
+    int phases = 1;
+    if (!std::isnan(device.measurements.find(Quantity::REALPOWER_OUTPUT_L3))) {
+        phases = 3;
+    } else if (!std::isnan(device.measurements.find(Quantity::REALPOWER_OUTPUT_L2))) {
+        phases = 2;
+    }
+    if (phases != device.phases) {
+        _phaseCounts[size_t(device.phases)]--;
+        _phaseCounts[size_t(phases)]++;
+        device.phases = phases;
+    }
 }
 
-bool TPUnit::changed(const std::string& quantity) const
+bool TPUnit::mixedPhases() const
 {
-    auto it = _changed.find(quantity);
-    if (it == _changed.end())
+    if (_powerdevices.empty()) {
         return false;
-    return it->second;
+    }
+    // the first device decides, as a 1-phase device in a 2-phase unit has no L2 output anyway
+    switch (_powerdevices.begin()->second.phases) {
+        case 1:
+            return (_phaseCounts[2] + _phaseCounts[3]) > 0;
+        case 2:
+            return _phaseCounts[3] > 0;
+        case 3:
+        default:
+            return (_phaseCounts[1] + _phaseCounts[2]) > 0;
+    }
 }
 
-void TPUnit::changed(const std::string& quantity, bool newStatus)
+bool TPUnit::changed(Quantity quantity) const
 {
-    if (changed(quantity) != newStatus) {
-        _changed[quantity]         = newStatus;
-        _changetimestamp[quantity] = uint64_t(::time(NULL));
-        if (_advertisedtimestamp.find(quantity) == _advertisedtimestamp.end()) {
-            _advertisedtimestamp[quantity] = 0;
-        }
+    return state(quantity).changed;
+}
+
+void TPUnit::changed(Quantity quantity, bool newStatus)
+{
+    auto& total = state(quantity);
+    if (total.changed != newStatus) {
+        total.changed         = newStatus;
+        total.changeTimestamp = Clock::now();
     }
 }
 
-uint64_t TPUnit::timestamp(const std::string& quantity) const
+uint64_t TPUnit::timestamp(Quantity quantity) const
 {
-    auto it = _changetimestamp.find(quantity);
-    if (it == _changetimestamp.end())
-        return 0;
-    return it->second;
+    return state(quantity).changeTimestamp;
 }
 
-int64_t TPUnit::timeToAdvertisement(const std::string& quantity) const
+int64_t TPUnit::timeToAdvertisement(Quantity quantity) const
 {
     auto quantityTimestamp = timestamp(quantity);
-    if ((quantityTimestamp == 0) || quantityIsUnknown(generateTopic(quantity))) {
+    if ((quantityTimestamp == 0) || quantityIsUnknown(quantity)) {
         // if quantity didn't change and it is still unknown
         return TPOWER_MEASUREMENT_REPEAT_AFTER;
     }
-    uint64_t dt = uint64_t(::time(NULL)) - quantityTimestamp;
+    if (changed(quantity) && throttled(quantity)) {
+        // the change is published once the minimal interval elapses
+        return int64_t(state(quantity).advertisedTimestamp + settings().minPublishInterval) - int64_t(Clock::now());
+    }
+    uint64_t dt = Clock::now() - quantityTimestamp;
     if (dt > TPOWER_MEASUREMENT_REPEAT_AFTER) {
         // no time left for waiting -> Need to advertise
         return 0;
@@ -347,32 +669,102 @@ int64_t TPUnit::timeToAdvertisement(const std::string& quantity) const
     return int64_t(TPOWER_MEASUREMENT_REPEAT_AFTER - dt);
 }
 
-bool TPUnit::advertise(const std::string& quantity) const
+bool TPUnit::advertise(Quantity quantity) const
 {
-    if (quantityIsUnknown(generateTopic(quantity))) {
+    if (quantityIsUnknown(quantity)) {
         // if we don't know the quantity -> nothing to advertise
         return false;
     }
 
-    uint64_t now_timestamp = uint64_t(::time(NULL));
-    // find the time, when quantity was advertised last time
-    const auto it = _advertisedtimestamp.find(quantity);
-    if ((it != _advertisedtimestamp.end()) && (it->second == now_timestamp)) {
-        // if time is known and
-        //    time is just now was advertised -> nothing to advertise
+    if (throttled(quantity)) {
+        // quantity was advertised just now -> nothing to advertise
         return false;
     }
 
+    uint64_t now_timestamp = Clock::now();
     // advertise if
     // * value changed or
     // * we should advertise according schedule
     return (changed(quantity) || ((now_timestamp - timestamp(quantity)) > TPOWER_MEASUREMENT_REPEAT_AFTER));
 }
 
-void TPUnit::advertised(const std::string& quantity)
+bool TPUnit::throttled(Quantity quantity) const
+{
+    // the time, when quantity was advertised last time
+    uint64_t advertisedTimestamp = state(quantity).advertisedTimestamp;
+    if (advertisedTimestamp == 0) {
+        return false;
+    }
+    // at most once a second, or less often if configured
+    uint64_t interval = std::max<uint64_t>(1, settings().minPublishInterval);
+    return (Clock::now() - advertisedTimestamp) < interval;
+}
+
+void TPUnit::advertised(Quantity quantity)
 {
     changed(quantity, false);
-    int64_t now_timestamp          = ::time(NULL);
-    _changetimestamp[quantity]     = uint64_t(now_timestamp);
-    _advertisedtimestamp[quantity] = uint64_t(now_timestamp);
+    auto&    total            = state(quantity);
+    uint64_t now_timestamp    = Clock::now();
+    total.changeTimestamp     = now_timestamp;
+    total.advertisedTimestamp = now_timestamp;
+
+    if (total.inputs.empty()) {
+        return;
+    }
+    // inputs in the future (clock of the device ahead) are counted as fresh
+    uint64_t lag = now_timestamp - std::min(now_timestamp, total.inputs.newestTimestamp());
+    uint64_t age = now_timestamp - std::min(now_timestamp, total.inputs.oldestTimestamp());
+    if (StageStats::enabled()) {
+        StageStats::record(Age::PUBLISH_LAG, lag);
+        StageStats::record(Age::INPUT_AGE, age);
+    }
+    if (quantity == Quantity::REALPOWER_DEFAULT) {
+        updateWindows();
+        for (auto& window : _staleness) {
+            window.publishLag.add(now_timestamp, double(lag));
+            window.inputAge.add(now_timestamp, double(age));
+        }
+    }
+}
+
+bool TPUnit::advertiseDue(const std::vector<Quantity>& quantities) const
+{
+    for (auto quantity : quantities) {
+        if (timeToAdvertisement(quantity) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int64_t TPUnit::timeToPublishWindow(const std::vector<Quantity>& quantities) const
+{
+    uint64_t now      = Clock::now();
+    uint64_t interval = std::max<uint64_t>(1, settings().minPublishInterval);
+    int64_t  result   = TPOWER_MEASUREMENT_REPEAT_AFTER;
+    for (auto quantity : quantities) {
+        if (!throttled(quantity)) {
+            return 0;
+        }
+        result = std::min(result, int64_t(state(quantity).advertisedTimestamp + interval - now));
+    }
+    return result;
+}
+
+size_t TPUnit::memoryUsage() const
+{
+    // red-black tree node: color, parent, left, right
+    static const size_t nodeOverhead = 4 * sizeof(void*);
+    static const size_t inplace      = std::string().capacity();
+
+    size_t result = sizeof(TPUnit) + (_children.capacity() + _parents.capacity()) * sizeof(TPUnit*) +
+                    _windows.capacity() * sizeof(RollingWindow) + _staleness.capacity() * sizeof(StalenessWindows) +
+                    _statistics.capacity() * sizeof(MetricInfo);
+    for (const auto& device : _powerdevices) {
+        result += nodeOverhead + sizeof(device);
+        if (device.first.capacity() > inplace) {
+            result += device.first.capacity() + 1;
+        }
+    }
+    return result;
 }
@@ -22,126 +22,435 @@
 
 #pragma once
 
+#include "measurement.h"
 #include "metriclist.h"
+#include "quantity.h"
+#include "rollingwindow.h"
+#include "tpowersettings.h"
+#include <algorithm>
+#include <array>
 #include <ctime>
 #include <functional>
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
-/// class representing total power calculation unit (rack or DC)
+/// kind of the calculation unit, it defines the set of totals computed together
+///
+/// Kinds are ordered by the location hierarchy, children before parents.
+enum class TPUnitKind
+{
+    RACK,  ///< realpower.default only
+    ROW,   ///< realpower.default only
+    ROOM,  ///< realpower.default only
+    DC,    ///< realpower.default, realpower.input.L1-3, realpower.output.L1-3, power.input.L1-3 and imbalance
+    GROUP, ///< realpower.default only, group of any units or power devices (tenant, zone)
+    COUNT
+};
+
+/// number of unit kinds
+constexpr size_t UNIT_KIND_COUNT = size_t(TPUnitKind::COUNT);
+
+/// measurements of one power device
+struct PowerDevice
+{
+    /// measurements: quantity -> Measurement
+    MetricList measurements;
+    /// output phases (1-3), given by the presence of realpower.output.L2/L3
+    int phases = 1;
+};
+
+/// range of timestamps of the measurements summed to a total
+struct InputSpan
+{
+    /// the oldest input, relative to Measurement::TIMESTAMP_BASE, UINT32_MAX if there is no input
+    uint32_t oldest = UINT32_MAX;
+    /// the newest input, relative to Measurement::TIMESTAMP_BASE
+    uint32_t newest = 0;
+
+    void add(const Measurement& measurement)
+    {
+        oldest = std::min(oldest, measurement.timestamp);
+        newest = std::max(newest, measurement.timestamp);
+    };
+    void add(const InputSpan& other)
+    {
+        oldest = std::min(oldest, other.oldest);
+        newest = std::max(newest, other.newest);
+    };
+
+    bool empty() const
+    {
+        return oldest > newest;
+    };
+    /// absolute timestamp of the oldest input [s], 0 if empty
+    uint64_t oldestTimestamp() const
+    {
+        return empty() ? 0 : Measurement::TIMESTAMP_BASE + oldest;
+    };
+    /// absolute timestamp of the newest input [s], 0 if empty
+    uint64_t newestTimestamp() const
+    {
+        return empty() ? 0 : Measurement::TIMESTAMP_BASE + newest;
+    };
+};
+
+/// class representing total power calculation unit (rack, row, room, DC or group)
 class TPUnit
 {
 public:
     /// calculate total value for all interesting quantities
-    void calculate(const std::vector<std::string>& quantities);
+    ///
+    /// Totals of the unit kind are computed in one pass over the devices,
+    /// other quantities one by one. Rolled-up totals are summed from the children.
+    void calculate(const std::vector<Quantity>& quantities);
     /// calculate total value for one quantity
-    void calculate(const std::string& quantity);
+    ///
+    /// Output totals are not calculated for devices with mixed output phases.
+    void calculate(Quantity quantity);
+    /// calculate two totals in one pass (e.g. a phase and the imbalance of phases)
+    void calculate(Quantity first, Quantity second);
 
     /// discard obsolete measurements
     void dropOldMetricInfos();
 
     /// get value of particular quantity. Method throws an exception if quantity is unknown.
-    double get(const std::string& quantity) const;
+    double get(Quantity quantity) const;
 
     /// set value of particular quantity.
-    void set(const std::string& quantity, const MetricInfo& measurement);
+    void set(Quantity quantity, const Measurement& measurement);
 
-    /// Metric Info per particular quantity.
-    MetricInfo getMetricInfo(const std::string& quantity) const;
+    /// Metric Info per particular quantity (built for publishing).
+    ///
+    /// The metric is kept by the unit and updated in place. Method throws an exception if quantity is unknown.
+    const MetricInfo& getMetricInfo(Quantity quantity);
 
     /// get set unit name
-    std::string name() const
+    const std::string& name() const
     {
         return _name;
     };
-    void name(const std::string& name)
+    void name(const std::string& name);
+    void name(const char* name)
+    {
+        this->name(std::string(name ? name : ""));
+    };
+
+    /// get/set unit kind
+    TPUnitKind kind() const
     {
-        _name = name;
+        return _kind;
     };
-    void name(const char* name)
+    void kind(TPUnitKind kind)
+    {
+        _kind = kind;
+    };
+
+    /// set settings shared by all units (deadbands, publishing interval)
+    void settings(const TPowerSettings* settings)
     {
-        _name = name ? name : "";
+        _settings = settings;
     };
 
-    /// returns true if at least one measurement of all included powerdevices is unknown
-    bool quantityIsUnknown(const std::string& quantity) const;
+    /// returns true if the total is unknown (at least one measurement of included powerdevices was unknown)
+    bool quantityIsUnknown(Quantity quantity) const;
     /// returns true if totalpower can be calculated.
-    bool quantityIsKnown(const std::string& quantity) const
+    bool quantityIsKnown(Quantity quantity) const
     {
         return !quantityIsUnknown(quantity);
     }
 
     /// returns list of devices in unknown state
-    std::vector<std::string> devicesInUnknownState(const std::string& quantity) const;
+    std::vector<std::string> devicesInUnknownState(Quantity quantity) const;
 
     /// add powerdevice to unit
     void addPowerDevice(const std::string& device);
 
     /// save new received measurement
     void setMeasurement(const MetricInfo& M);
+    /// save new received measurement of the device
+    void setMeasurement(std::string_view deviceName, const Measurement& measurement);
 
     /// returns true if measurement is changend and we should advertised
-    bool changed(const std::string& quantity) const;
+    bool changed(Quantity quantity) const;
 
     /// set/clear changed status
-    void changed(const std::string& quantity, bool newStatus);
+    void changed(Quantity quantity, bool newStatus);
 
     /// returns true if measurement should be send (changed is true or we did not send it for long time)
-    bool advertise(const std::string& quantity) const;
+    bool advertise(Quantity quantity) const;
+
+    /// returns true if the minimal publishing interval did not elapse since the last advertisement
+    bool throttled(Quantity quantity) const;
 
     /// set timestamp of the last publishing moment
-    void advertised(const std::string& quantity);
+    void advertised(Quantity quantity);
+
+    /// returns true if some of quantities should be republished according the schedule
+    bool advertiseDue(const std::vector<Quantity>& quantities) const;
+
+    /// time until at least one of quantities can be published [s], 0 if it can be published now
+    int64_t timeToPublishWindow(const std::vector<Quantity>& quantities) const;
+
+    /// returns true if new measurements were received since the last calculation
+    bool dirty() const
+    {
+        return _dirty;
+    };
+    /// set/clear dirty status
+    void dirty(bool newStatus)
+    {
+        _dirty = newStatus;
+    };
 
     /// time to next advertisement [s]
-    int64_t timeToAdvertisement(const std::string& quantity) const;
+    int64_t timeToAdvertisement(Quantity quantity) const;
 
     /// return timestamp for quantity change
-    uint64_t timestamp(const std::string& quantity) const;
+    uint64_t timestamp(Quantity quantity) const;
 
-protected:
-    /// A list of the last measurement values:  topic -> MetricInfo
-    MetricList _lastValue;
+    /// number of recalculated values not reported as changed because of the deadband
+    uint64_t deadbandSuppressed() const
+    {
+        return _deadbandSuppressed;
+    };
+
+    /// number of calculations of the unit (one pass computing any number of totals)
+    uint64_t calculations() const
+    {
+        return _calculations;
+    };
+
+    /// add child unit, rolled-up totals are the sum of children totals
+    ///
+    /// The child must be calculated before the unit (see TPUnitKind).
+    void addChild(TPUnit* child);
+    /// units summed from this unit
+    const std::vector<TPUnit*>& parents() const
+    {
+        return _parents;
+    };
+    /// get/set quantity::mask() of totals summed from the children
+    uint32_t rollup() const
+    {
+        return _rollupMask;
+    };
+    void rollup(uint32_t mask)
+    {
+        _rollupMask = mask;
+    };
+
+    /// rolling statistics of realpower.default as metrics (avg, min and max per window)
+    ///
+    /// With TPowerSettings::stalenessStatistics, average and maximum of the publish lag and of the input
+    /// age per window follow. Metrics are updated in place, value is NAN if nothing was calculated within the window.
+    const std::vector<MetricInfo>& statistics(uint64_t now);
+    /// rolling statistics of realpower.default in the window, see TPowerSettings::statisticWindows
+    RollingWindow::Stats statistics(size_t window, uint64_t now) const
+    {
+        return (window < _windows.size()) ? _windows[window].stats(now) : RollingWindow::Stats();
+    };
+
+    /// the last calculated total (not hidden by the deadband), NAN if unknown
+    double current(Quantity quantity) const
+    {
+        return state(quantity).current;
+    };
+
+    /// timestamps of the measurements summed to the last calculated total, empty if unknown
+    const InputSpan& inputs(Quantity quantity) const
+    {
+        return state(quantity).inputs;
+    };
+
+    /// realpower.default.oldest_input: timestamp of the oldest input of the total [s], updated in place
+    ///
+    /// Value is NAN if the total is unknown.
+    const MetricInfo& oldestInputMetric(uint64_t now);
+
+    /// get/set thresholds of realpower.default, nullptr if not checked
+    const Threshold* threshold() const
+    {
+        return _threshold;
+    };
+    void threshold(const Threshold* threshold)
+    {
+        _threshold = threshold;
+    };
+    /// get/set state of realpower.default against the thresholds
+    ThresholdState thresholdState() const
+    {
+        return _thresholdState;
+    };
+    void thresholdState(ThresholdState state)
+    {
+        _thresholdState = state;
+    };
+
+    /// energy integrated from realpower.default totals [Wh]
+    double energy() const
+    {
+        return _energy.energy;
+    };
+    /// set energy (e.g. restored state) [Wh], integration starts again with the next total
+    void energy(double energy)
+    {
+        _energy        = EnergyCounter();
+        _energy.energy = energy;
+    };
+    /// energy as metric energy.default [kWh], updated in place
+    const MetricInfo& energyMetric(uint64_t now);
 
-    /// measurement status
-    std::map<std::string, bool> _changed;
+    /// number of power devices
+    size_t devices() const
+    {
+        return _powerdevices.size();
+    };
 
-    /// measurement change timestamp
-    std::map<std::string, uint64_t> _changetimestamp;
+    /// estimated heap memory used by the unit [B], interned names are not included
+    size_t memoryUsage() const;
 
-    /// measurement advertisement timestamp
-    std::map<std::string, uint64_t> _advertisedtimestamp;
+protected:
+    /// state of one total
+    struct QuantityState
+    {
+        /// the last value, NAN if unknown
+        Measurement lastValue;
+        /// the last calculated value (not hidden by the deadband), NAN if unknown
+        double current = std::nan("");
+        /// the last value built for publishing (names are set with the unit name)
+        MetricInfo published;
+        /// measurement status
+        bool changed = false;
+        /// measurement change timestamp
+        uint64_t changeTimestamp = 0;
+        /// measurement advertisement timestamp, 0 if never advertised
+        uint64_t advertisedTimestamp = 0;
+        /// timestamps of the inputs of the last calculated value
+        InputSpan inputs;
+    };
+
+    /// state of totals, indexed by Quantity
+    std::array<QuantityState, QUANTITY_COUNT> _quantities;
 
     /// list of measurements for included devices
     ///
-    ///     map---device1---map---realpower.default---MetricInfo
-    ///      |               +----realpower.input.L1--MetricInfo
-    ///      |               +----realpower.input.L2--MetricInfo
-    ///      |               +----realpower.input.L3--MetricInfo
+    ///     map---device1---array---realpower.default---Measurement
+    ///      |                +-----realpower.input.L1--Measurement
+    ///      |                +-----realpower.input.L2--Measurement
+    ///      |                +-----realpower.input.L3--Measurement
     ///      +----device2-...
-    std::map<std::string, MetricList> _powerdevices;
+    std::map<std::string, PowerDevice, std::less<>> _powerdevices;
+
+    /// number of devices per output phases (index 1-3)
+    std::array<int, 4> _phaseCounts = {0, 0, 0, 0};
 
     /// unit name
     std::string _name;
+    /// unit name ID in NameRegistry::elements()
+    uint32_t _nameId = NameRegistry::NONE;
+
+    /// unit kind
+    TPUnitKind _kind = TPUnitKind::RACK;
+
+    /// shared settings, defaults are used if not set
+    const TPowerSettings* _settings = nullptr;
+
+    /// counter of values hidden by the deadband
+    uint64_t _deadbandSuppressed = 0;
+    /// counter of calculations
+    uint64_t _calculations = 0;
+
+    /// new measurements were received since the last calculation
+    bool _dirty = false;
+
+    /// units summed to the rolled-up totals
+    std::vector<TPUnit*> _children;
+    /// units summing this unit
+    std::vector<TPUnit*> _parents;
+    /// quantity::mask() of totals summed from the children
+    uint32_t _rollupMask = 0;
+
+    /// rolling statistics of realpower.default, one per window of the settings
+    std::vector<RollingWindow> _windows;
+    /// windows of _windows [s], as given by the settings
+    std::vector<uint32_t> _windowSeconds;
+    /// _staleness is built for the windows
+    bool _stalenessWindows = false;
+    /// staleness of published realpower.default, one per window of the settings
+    struct StalenessWindows
+    {
+        /// time from the newest input to the publishing [s]
+        RollingWindow publishLag;
+        /// time from the oldest input to the publishing [s]
+        RollingWindow inputAge;
+    };
+    std::vector<StalenessWindows> _staleness;
+    /// statistics built for publishing (names are set when windows are built)
+    std::vector<MetricInfo> _statistics;
+    /// oldest input built for publishing
+    MetricInfo _oldestInputPublished;
+
+    /// trapezoidal integral of realpower.default
+    struct EnergyCounter
+    {
+        /// energy [Wh]
+        double energy = 0;
+        /// the last integrated total [W], NAN if the integration was interrupted
+        double lastPower = std::nan("");
+        /// timestamp of the last integrated total [s]
+        uint64_t lastTimestamp = 0;
+    };
+    EnergyCounter _energy;
+    /// energy built for publishing
+    MetricInfo _energyPublished;
+
+    /// thresholds of realpower.default (owned by the settings), nullptr if not checked
+    const Threshold* _threshold = nullptr;
+    /// state of realpower.default against the thresholds
+    ThresholdState _thresholdState = ThresholdState::OK;
+
+    /// build the total of the unit
+    Measurement total(Quantity quantity, double value, uint64_t timestamp) const;
+
+    /// update phases of the device after the set of its measurements changed
+    void updatePhases(PowerDevice& device);
 
-    /// replace not present measurement with another
-    static const std::map<std::string, std::string> _emergencyReplacements;
+    /// returns true if devices have different output phases (phases are given by the first device)
+    bool mixedPhases() const;
 
-    /// replace not present measurement with some algorithm
-    static const std::map<std::string, int> _calculations;
+    /// calculate all totals of the Kernel in one pass over devices, other quantities one by one
+    template <class Kernel>
+    void calculateFused(const Quantity* first, const Quantity* last);
 
-    double getMetricValue(
-        const MetricList& measurements, const std::string& quantity, const std::string& deviceName) const;
+    /// calculate rolled-up total as the sum of the last calculated totals of the children
+    void calculateRollup(Quantity quantity, uint64_t now);
+
+    /// rebuild statistic windows if the settings changed
+    void updateWindows();
+
+    /// add area under realpower.default since the last total to the energy
+    ///
+    /// Integration doesn't cross gaps longer than TTL of totals or time going backward.
+    void integrate(uint64_t timestamp, double power);
 
-    /// calculate simple sum over devices considering the replacement table
-    MetricInfo simpleSummarize(const std::string& quantity) const;
-    /// calculate realpower sum over devices
-    MetricInfo realpowerDefault(const std::string& quantity) const;
-    /// send realpower output or null in case of phase incompatibilities
-    MetricInfo realpowerOutput(const std::string& quantity) const;
+    /// the total can't be calculated
+    void unknown(Quantity quantity);
+
+    QuantityState& state(Quantity quantity)
+    {
+        return _quantities[size_t(quantity)];
+    };
+    const QuantityState& state(Quantity quantity) const
+    {
+        return _quantities[size_t(quantity)];
+    };
 
 private:
-    std::string generateTopic(const std::string& quantity) const;
+    std::string generateTopic(Quantity quantity) const;
+
+    const TPowerSettings& settings() const;
 
     /// time to live of the generated metrics [s]
     static const uint64_t TTL = 6 * 60;
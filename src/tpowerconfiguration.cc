@@ -21,15 +21,26 @@
 
 #include "tpowerconfiguration.h"
 #include "calc_power.h"
+#include "clock.h"
+#include "probes.h"
+#include "stagestats.h"
 #include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <czmq.h>
 #include <errno.h>
 #include <exception>
+#include <fstream>
 #include <fty_common.h>
 #include <fty_common_db_asset.h>
 #include <fty_common_db_dbpath.h>
 #include <fty_common_str_defs.h>
 #include <iostream>
+#include <set>
+#include <sstream>
 #include <stdio.h>
+#include <stdexcept>
 #include <stdlib.h>
 #include <string>
 
@@ -37,59 +48,90 @@
 #define ANSI_COLOR_RED   "\x1b[1;31m"
 #define ANSI_COLOR_RESET "\x1b[0m"
 
+static const char* s_kindName(TPUnitKind kind)
+{
+    switch (kind) {
+        case TPUnitKind::RACK:
+            return "rack";
+        case TPUnitKind::ROW:
+            return "row";
+        case TPUnitKind::ROOM:
+            return "room";
+        case TPUnitKind::DC:
+            return "DC";
+        case TPUnitKind::GROUP:
+            return "group";
+        default:
+            return "unit";
+    }
+}
+
 bool TotalPowerConfiguration::configure(void)
 {
     log_info("loading power topology");
+    StageTimer timer(Stage::CONFIGURE);
+    TPOWER_PROBE0(configure__start);
 
     // TODO should be rewritten, for usinf messages
     try {
-        // remove old topology
-        _racks.clear();
-        _affectedRacks.clear();
-        _DCs.clear();
-        _affectedDCs.clear();
-
         // connect to the database
         tntdb::Connection connection = tntdb::connectCached(DBConn::url);
 
         // reading racks
-        auto ret = select_devices_total_power_racks(connection); // calc_power.cc
-        if (ret.status) {
-            log_info("reading racks (count: %lu)...", ret.item.size());
-            for (auto& rack : ret.item) {
-                std::string aux;
-                auto&       devices = rack.second;
-                for (auto& device : devices) {
-                    addDeviceToMap(_racks, _affectedRacks, rack.first, device);
-                    aux += (aux.empty() ? "" : ", ") + device;
-                }
-                log_info(ANSI_COLOR_BOLD "rack '%s' powerdevices: %s" ANSI_COLOR_RESET, rack.first.c_str(),
-                    aux.empty() ? "<empty>" : aux.c_str());
-            }
+        auto racks = select_devices_total_power_racks(connection); // calc_power.cc
+        if (racks.status) {
+            log_info("reading racks (count: %lu)...", racks.item.size());
+        } else {
+            racks.item.clear();
         }
 
         // reading DCs
-        ret = select_devices_total_power_dcs(connection); // calc_power.cc
-        if (ret.status) {
-            log_info("reading DCs (count: %lu)...", ret.item.size());
-            for (auto& dc : ret.item) {
-                std::string aux;
-                auto&       devices = dc.second;
-                for (auto& device : devices) {
-                    addDeviceToMap(_DCs, _affectedDCs, dc.first, device);
-                    aux += ((!aux.empty()) ? ", " : "") + device;
-                }
-                log_info(ANSI_COLOR_BOLD "DC '%s' powerdevices: %s" ANSI_COLOR_RESET, dc.first.c_str(),
-                    aux.empty() ? "<empty>" : aux.c_str());
+        auto dcs = select_devices_total_power_dcs(connection); // calc_power.cc
+        if (dcs.status) {
+            log_info("reading DCs (count: %lu)...", dcs.item.size());
+        } else {
+            dcs.item.clear();
+        }
+
+        // reading rows, rooms and the location hierarchy (used for roll-up)
+        LocationTopology locations;
+        auto             rows = select_devices_total_power_rows(connection); // calc_power.cc
+        if (rows.status) {
+            log_info("reading rows (count: %lu)...", rows.item.size());
+            locations.rows = rows.item;
+        }
+        auto rooms = select_devices_total_power_rooms(connection); // calc_power.cc
+        if (rooms.status) {
+            log_info("reading rooms (count: %lu)...", rooms.item.size());
+            locations.rooms = rooms.item;
+        }
+        auto children = select_location_children(connection); // calc_power.cc
+        if (children.status) {
+            locations.children = children.item;
+        }
+
+        // reading groups given by asset attributes, then static ones
+        if (!_settings.groupAttributes.empty()) {
+            auto groups = select_groups_by_attributes(connection, _settings.groupAttributes); // calc_power.cc
+            if (groups.status) {
+                log_info("reading groups (count: %lu)...", groups.item.size());
+                locations.groups = groups.item;
             }
         }
+        for (auto& group : _settings.groups) {
+            auto& members = locations.groups[group.first];
+            members.insert(members.end(), group.second.begin(), group.second.end());
+        }
 
         connection.close();
 
+        loadTopology(racks.item, dcs.item, locations);
+
         // no reconfiguration should be scheduled
         _reconfigPending = 0;
 
         log_info("topology loaded with success");
+        TPOWER_PROBE2(configure__done, 1, racks.item.size() + dcs.item.size());
         return true;
     } catch (const std::exception& e) {
         log_error("Failed to read configuration from database. Excepton caught: '%s'.", e.what());
@@ -97,122 +139,520 @@ bool TotalPowerConfiguration::configure(void)
         log_error("Failed to read configuration from database. Unknown exception caught.");
     }
 
-    _reconfigPending = ::time(NULL) + 60; // retry later
+    _reconfigPending = int64_t(Clock::now()) + 60; // retry later
+    TPOWER_PROBE2(configure__done, 0, 0);
     return false;
 }
 
-void TotalPowerConfiguration::addDeviceToMap(std::map<std::string, TPUnit>& elements,   // owners map
-    std::map<std::string, std::string>&                                     reverseMap, // device -> owner
-    const std::string& owner,  // datacenter-3, rack-5, ... (asset name)
-    const std::string& device) // ups-xx, epdu-yy, ... (asset name)
+void TotalPowerConfiguration::loadTopology(
+    const PowerTopology& racks, const PowerTopology& dcs, const LocationTopology& locations)
+{
+    // remove old topology, keep its counters and active alerts
+    _stats = publishStats();
+    std::map<std::string, TPUnit> alerting;
+    for (auto& unitLevel : _levels) {
+        for (auto& unit : unitLevel.units) {
+            _energyState[unit.first] = unit.second.energy();
+            if (unit.second.thresholdState() != ThresholdState::OK) {
+                alerting.emplace(unit.first, std::move(unit.second));
+            }
+        }
+    }
+    for (auto& level : _levels) {
+        level.units.clear();
+        level.owners.clear();
+        level.pending.clear();
+    }
+    _filter.clear();
+
+    // power devices of the locations, other members of groups never report realpower
+    std::set<std::string> powerDevices;
+    for (const auto* topology : {&racks, &locations.rows, &locations.rooms, &dcs}) {
+        for (const auto& unit : *topology) {
+            powerDevices.insert(unit.second.begin(), unit.second.end());
+        }
+    }
+
+    // groups are powered by the devices of their members and summed from the member units
+    PowerTopology groups, groupChildren;
+    for (auto& group : locations.groups) {
+        auto& devices = groups[group.first];
+        for (auto& member : group.second) {
+            const std::vector<std::string>* memberDevices = nullptr;
+            for (const auto* topology : {&racks, &locations.rows, &locations.rooms, &dcs}) {
+                auto unit = topology->find(member);
+                if (unit != topology->end()) {
+                    memberDevices = &unit->second;
+                    break;
+                }
+            }
+            if (memberDevices && !memberDevices->empty()) {
+                devices.insert(devices.end(), memberDevices->begin(), memberDevices->end());
+                groupChildren[group.first].push_back(member);
+            } else if (powerDevices.count(member)) {
+                // power device, the group is summed from devices
+                devices.push_back(member);
+            } else {
+                log_warning("member '%s' of group '%s' ignored (not a power device or a powered location)",
+                    member.c_str(), group.first.c_str());
+            }
+        }
+    }
+
+    const std::array<const PowerTopology*, UNIT_KIND_COUNT> topologies = {
+        &racks, &locations.rows, &locations.rooms, &dcs, &groups};
+
+    for (size_t kind = 0; kind < UNIT_KIND_COUNT; ++kind) {
+        for (auto& unit : *topologies[kind]) {
+            std::string aux;
+            auto&       devices = unit.second;
+            for (auto& device : devices) {
+                addDeviceToMap(unit.first, device, TPUnitKind(kind));
+                aux += (aux.empty() ? "" : ", ") + device;
+            }
+            log_info(ANSI_COLOR_BOLD "%s '%s' powerdevices: %s" ANSI_COLOR_RESET, s_kindName(TPUnitKind(kind)),
+                unit.first.c_str(), aux.empty() ? "<empty>" : aux.c_str());
+        }
+    }
+
+    const PowerTopology* parents[] = {&locations.children, &groupChildren};
+    for (const auto* children : parents) {
+        for (auto& parent : *children) {
+            addRollup(parent.first, parent.second, topologies);
+        }
+    }
+
+    for (size_t kind = 0; kind < UNIT_KIND_COUNT; ++kind) {
+        routeDevices(*topologies[kind], TPUnitKind(kind));
+        _levels[kind].owners.build();
+    }
+    assignThresholds();
+
+    // active alerts go on, alerts of removed units are resolved
+    for (auto& old : alerting) {
+        TPUnit* unit = findUnit(old.first);
+        if (unit && unit->threshold()) {
+            unit->thresholdState(old.second.thresholdState());
+        } else {
+            sendAlert(old.second, old.second.thresholdState(), false);
+        }
+    }
+
+    auto memory = memoryReport();
+    log_info("topology memory: %zu B for %zu devices (%zu B/device)", memory.bytes(), memory.devices,
+        memory.bytesPerDevice());
+
+    if (_recorder.isOpen()) {
+        // the replay needs the topology the metrics were recorded with
+        saveTopologySnapshot(_recorder.path() + ".topology", racks, dcs, locations);
+    }
+}
+
+MemoryReport TotalPowerConfiguration::memoryReport() const
+{
+    // red-black tree node: color, parent, left, right
+    static const size_t nodeOverhead = 4 * sizeof(void*);
+    static const size_t inplace      = std::string().capacity();
+
+    auto stringBytes = [](const std::string& s) {
+        return (s.capacity() > inplace) ? s.capacity() + 1 : 0;
+    };
+
+    MemoryReport result;
+    for (const auto& level : _levels) {
+        for (const auto& unit : level.units) {
+            result.devices += unit.second.devices();
+            result.unitsBytes += nodeOverhead + stringBytes(unit.first) + unit.second.memoryUsage();
+        }
+        result.mapsBytes += level.owners.memoryUsage();
+    }
+    result.namesBytes = NameRegistry::elements().memoryUsage() + NameRegistry::units().memoryUsage();
+    return result;
+}
+
+TPUnit* TotalPowerConfiguration::findUnit(const std::string& name)
 {
-    auto element = elements.find(owner);
+    for (auto& level : _levels) {
+        auto unit = level.units.find(name);
+        if (unit != level.units.end()) {
+            return &unit->second;
+        }
+    }
+    return nullptr;
+}
+
+void TotalPowerConfiguration::addDeviceToMap(const std::string& owner, // datacenter-3, rack-5, ... (asset name)
+    const std::string& device, // ups-xx, epdu-yy, ... (asset name)
+    TPUnitKind         kind)
+{
+    auto& elements = level(kind).units;
+    auto  element  = elements.find(owner);
     if (element == elements.end()) {
         auto box = TPUnit();
         box.name(owner);
-        box.addPowerDevice(device);
-        elements[owner] = box;
-    } else {
-        element->second.addPowerDevice(device);
+        box.kind(kind);
+        box.settings(&_settings);
+        auto energy = _energyState.find(owner);
+        if (energy != _energyState.end()) {
+            box.energy(energy->second);
+        }
+        element = elements.emplace(owner, box).first;
     }
-    reverseMap[device] = owner;
+    element->second.addPowerDevice(device);
 }
 
-void TotalPowerConfiguration::processAsset(fty_proto_t* message)
+void TotalPowerConfiguration::addRollup(const std::string& parent, const std::vector<std::string>& children,
+    const std::array<const PowerTopology*, UNIT_KIND_COUNT>& topologies)
 {
-    std::string operation(fty_proto_operation(message));
-    if (operation != FTY_PROTO_ASSET_OP_CREATE && operation != FTY_PROTO_ASSET_OP_UPDATE &&
-        operation != FTY_PROTO_ASSET_OP_DELETE && operation != FTY_PROTO_ASSET_OP_RETIRE) {
+    TPUnit* parentUnit = findUnit(parent);
+    if (!parentUnit) {
+        // no power devices, nothing to sum
         return;
     }
+    const auto& parentDevices = topologies[size_t(parentUnit->kind())]->at(parent);
+
+    // children must be powered by exactly the devices of the parent, each device by one child
+    std::vector<TPUnit*>  childUnits;
+    std::set<std::string> devices;
+    size_t                count = 0;
+    uint32_t              mask  = level(parentUnit->kind()).quantitiesMask;
+    for (const auto& child : children) {
+        TPUnit* childUnit = findUnit(child);
+        if (!childUnit) {
+            // no power devices, it adds nothing
+            continue;
+        }
+        if (childUnit->kind() >= parentUnit->kind()) {
+            log_warning("%s '%s' can't be summed from %s '%s'", s_kindName(parentUnit->kind()), parent.c_str(),
+                s_kindName(childUnit->kind()), child.c_str());
+            return;
+        }
+        const auto&           childDevices = topologies[size_t(childUnit->kind())]->at(child);
+        std::set<std::string> unique(childDevices.begin(), childDevices.end());
+        devices.insert(unique.begin(), unique.end());
+        count += unique.size();
+        mask &= level(childUnit->kind()).quantitiesMask;
+        childUnits.push_back(childUnit);
+    }
 
-    // something is beeing reconfigured, let things to settle down
-    if (_reconfigPending == 0) {
-        log_info("Reconfiguration scheduled");
-        _reconfigPending = ::time(NULL) + 60; // in 60[s]
+    std::set<std::string> expected(parentDevices.begin(), parentDevices.end());
+    if (childUnits.empty() || (mask == 0) || (count != devices.size()) || (devices != expected)) {
+        log_info("%s '%s' is summed from power devices (children are powered differently)",
+            s_kindName(parentUnit->kind()), parent.c_str());
+        return;
     }
-    _timeout = getPollInterval();
-    log_info("ASSET %s, %s operation processed", fty_proto_name(message), operation.c_str());
+
+    for (TPUnit* childUnit : childUnits) {
+        parentUnit->addChild(childUnit);
+    }
+    parentUnit->rollup(mask);
+    log_info(ANSI_COLOR_BOLD "%s '%s' is summed from %zu children" ANSI_COLOR_RESET, s_kindName(parentUnit->kind()),
+        parent.c_str(), childUnits.size());
 }
 
-bool TotalPowerConfiguration::isRackQuantity(const std::string& quantity) const
+void TotalPowerConfiguration::routeDevices(const PowerTopology& topology, TPUnitKind kind)
 {
-    return std::find(_rackQuantities.begin(), _rackQuantities.end(), quantity) != _rackQuantities.end();
+    auto& unitLevel = level(kind);
+    for (auto& unit : topology) {
+        auto element = unitLevel.units.find(unit.first);
+        if (element == unitLevel.units.end()) {
+            continue;
+        }
+        // quantities summed from devices
+        uint32_t direct = unitLevel.quantitiesMask & ~element->second.rollup();
+        uint32_t inputs = unitLevel.inputsMask & ~element->second.rollup();
+        if (direct == 0) {
+            // summed from the children only
+            continue;
+        }
+        for (auto& device : unit.second) {
+            // units live in the map, so the pointer stays valid until the next topology load
+            unitLevel.owners.add(NameRegistry::elements().intern(device), &element->second);
+
+            // quick reject of other metrics
+            for (size_t q = 0; q < QUANTITY_COUNT; ++q) {
+                if ((quantity::mask(Quantity(q)) & inputs) != 0) {
+                    _filter.add(device, Quantity(q));
+                }
+            }
+        }
+    }
 }
 
-bool TotalPowerConfiguration::isDCQuantity(const std::string& quantity) const
+void TotalPowerConfiguration::settings(const TPowerSettings& settings)
 {
-    return std::find(_dcQuantities.begin(), _dcQuantities.end(), quantity) != _dcQuantities.end();
+    if ((settings.groups != _settings.groups) || (settings.groupAttributes != _settings.groupAttributes)) {
+        // groups are part of the topology
+        log_info("Reconfiguration scheduled (groups changed)");
+        _reconfigPending = int64_t(Clock::now());
+    }
+    if (!settings.stateFile.empty() && (settings.stateFile != _settings.stateFile)) {
+        loadState(settings.stateFile);
+    }
+    if (settings.recordFile != _settings.recordFile) {
+        _recorder.close();
+        if (!settings.recordFile.empty() && _recorder.open(settings.recordFile)) {
+            // the topology snapshot is saved by the reload
+            log_info("Reconfiguration scheduled (recording started)");
+            _reconfigPending = int64_t(Clock::now());
+        }
+    }
+    // alerts of removed thresholds are resolved while their limits are known
+    for (auto& unitLevel : _levels) {
+        for (auto& unit : unitLevel.units) {
+            if ((unit.second.thresholdState() != ThresholdState::OK) && !settings.thresholds.count(unit.first)) {
+                sendAlert(unit.second, unit.second.thresholdState(), false);
+                unit.second.thresholdState(ThresholdState::OK);
+            }
+        }
+    }
+    _settings = settings;
+    _timeout  = getPollInterval();
+    StageStats::enable(_settings.statsEnabled);
+    // thresholds are owned by the settings
+    assignThresholds();
 }
 
-void TotalPowerConfiguration::processMetric(const MetricInfo& M, const std::string& topic)
+void TotalPowerConfiguration::assignThresholds()
 {
-    // topic: <quantity>@<asset_name>
-    // ex.: 'realpower.input.L3@epdu-42'
-    std::string quantity = topic.substr(0, topic.find('@'));
+    for (auto& unitLevel : _levels) {
+        for (auto& unit : unitLevel.units) {
+            auto threshold = _settings.thresholds.find(unit.first);
+            unit.second.threshold((threshold != _settings.thresholds.end()) ? &threshold->second : nullptr);
+        }
+    }
+}
 
-    log_trace("processMetric %s", topic.c_str());
-    bool used = false, rackMeasureSent = false, dcMeasureSent = false;
+void TotalPowerConfiguration::checkThreshold(TPUnit& unit)
+{
+    const Threshold* threshold = unit.threshold();
+    if (!threshold) {
+        return;
+    }
+    ThresholdState previous = unit.thresholdState();
+    ThresholdState state    = threshold->evaluate(previous, unit.current(Quantity::REALPOWER_DEFAULT));
+    if (state == previous) {
+        return;
+    }
+    unit.thresholdState(state);
+    if (previous != ThresholdState::OK) {
+        sendAlert(unit, previous, false);
+    }
+    if (state != ThresholdState::OK) {
+        sendAlert(unit, state, true);
+    }
+}
 
-    // ASSUMPTION: one device can affect only one ASSET of each type ( Datacenter or Rack )
+void TotalPowerConfiguration::sendAlert(const TPUnit& unit, ThresholdState limit, bool active)
+{
+    ThresholdAlert alert;
+    alert.unit      = unit.name();
+    alert.quantity  = Quantity::REALPOWER_DEFAULT;
+    alert.limit     = limit;
+    alert.active    = active;
+    alert.value     = unit.current(alert.quantity);
+    alert.threshold = (limit == ThresholdState::HIGH) ? unit.threshold()->high : unit.threshold()->low;
+    alert.timestamp = Clock::now();
+
+    log_info(ANSI_COLOR_BOLD "%s@%s %s threshold alert %s (value: %f, threshold: %f)" ANSI_COLOR_RESET,
+        quantity::name(alert.quantity), alert.unit.c_str(), (limit == ThresholdState::HIGH) ? "high" : "low",
+        active ? "active" : "resolved", alert.value, alert.threshold);
+    if (_alertFunction) {
+        try {
+            _alertFunction(alert);
+        } catch (...) {
+            log_error(ANSI_COLOR_RED "Some unexpected error during sending alert" ANSI_COLOR_RESET);
+        }
+    }
+}
 
-    if (isRackQuantity(quantity)) {
-        auto affected_it = _affectedRacks.find(M.getElementName());
-        if (affected_it != _affectedRacks.end()) {
-            // the metric affects some total rack power
-            log_trace("%s is interesting for rack %s", topic.c_str(), affected_it->second.c_str());
+bool TotalPowerConfiguration::saveState()
+{
+    _stateSaved = int64_t(Clock::now());
+    if (_settings.stateFile.empty()) {
+        return false;
+    }
 
-            auto rack = _racks.find(affected_it->second); // < std::string, TPUnit > &rack;
-            if (rack != _racks.end()) {
-                // affected rack found, handle the new metric
-                rack->second.setMeasurement(M);                     // register the measure
-                rackMeasureSent = sendMeasurement(*rack, quantity); // compute + send conditionally
-                used            = true;
-            }
+    zconfig_t* root  = zconfig_new("root", nullptr);
+    size_t     count = 0;
+    for (auto& unitLevel : _levels) {
+        for (auto& unit : unitLevel.units) {
+            zconfig_putf(root, ("energy/" + unit.first).c_str(), "%.3f", unit.second.energy());
+            count++;
         }
     }
 
-    if (isDCQuantity(quantity)) {
-        auto affected_it = _affectedDCs.find(M.getElementName());
-        if (affected_it != _affectedDCs.end()) {
-            // the metric affects some total DC power
-            log_trace("%s is interesting for DC %s", topic.c_str(), affected_it->second.c_str());
+    // replace the old state at once
+    std::string tmp = _settings.stateFile + ".tmp";
+    bool        ok  = (zconfig_save(root, tmp.c_str()) == 0) &&
+              (std::rename(tmp.c_str(), _settings.stateFile.c_str()) == 0);
+    zconfig_destroy(&root);
 
-            auto dc = _DCs.find(affected_it->second); // < std::string, TPUnit > &dc;
-            if (dc != _DCs.end()) {
-                // affected dc found, handle the new metric
-                dc->second.setMeasurement(M);                   // register the measure
-                dcMeasureSent = sendMeasurement(*dc, quantity); // compute + send conditionally
-                used          = true;
+    if (!ok) {
+        log_error("cannot save state to '%s'", _settings.stateFile.c_str());
+        return false;
+    }
+    log_debug("state of %zu units saved to '%s'", count, _settings.stateFile.c_str());
+    return true;
+}
+
+bool TotalPowerConfiguration::loadState(const std::string& path)
+{
+    zconfig_t* root = zconfig_load(path.c_str());
+    if (!root) {
+        log_warning("cannot load state from '%s'", path.c_str());
+        return false;
+    }
+
+    size_t     count   = 0;
+    zconfig_t* section = zconfig_locate(root, "energy");
+    for (zconfig_t* child = section ? zconfig_child(section) : nullptr; child; child = zconfig_next(child)) {
+        const char* value  = zconfig_value(child);
+        double      energy = value ? std::strtod(value, nullptr) : 0;
+        if (!(energy >= 0)) {
+            continue;
+        }
+        _energyState[zconfig_name(child)] = energy;
+        if (TPUnit* unit = findUnit(zconfig_name(child))) {
+            unit->energy(energy);
+        }
+        count++;
+    }
+    zconfig_destroy(&root);
+
+    log_info("energy of %zu units loaded from '%s'", count, path.c_str());
+    return true;
+}
+
+void TotalPowerConfiguration::processAsset(fty_proto_t* message)
+{
+    std::string operation(fty_proto_operation(message));
+    if (operation != FTY_PROTO_ASSET_OP_CREATE && operation != FTY_PROTO_ASSET_OP_UPDATE &&
+        operation != FTY_PROTO_ASSET_OP_DELETE && operation != FTY_PROTO_ASSET_OP_RETIRE) {
+        return;
+    }
+
+    // something is beeing reconfigured, let things to settle down
+    if (_reconfigPending == 0) {
+        log_info("Reconfiguration scheduled");
+        _reconfigPending = int64_t(Clock::now()) + 60; // in 60[s]
+    }
+    _timeout = getPollInterval();
+    log_info("ASSET %s, %s operation processed", fty_proto_name(message), operation.c_str());
+}
+
+void TotalPowerConfiguration::processMetric(const MetricSample& sample)
+{
+    // topic: <quantity>@<asset_name>
+    // ex.: 'realpower.input.L3@epdu-42'
+    Quantity quantity = interestingQuantity(sample.element, sample.quantity);
+    if (quantity == Quantity::UNKNOWN) {
+        log_trace("processMetric %.*s@%.*s was ignored", int(sample.quantity.size()), sample.quantity.data(),
+            int(sample.element.size()), sample.element.data());
+        return;
+    }
+    processMetric(sample, quantity);
+}
+
+void TotalPowerConfiguration::processMetric(const MetricSample& sample, Quantity quantity)
+{
+    Clock::Cache clock; // one clock read for all units
+
+    // strings are not null terminated
+    int         quantityLen = int(sample.quantity.size());
+    const char* quantityStr = sample.quantity.data();
+    int         elementLen  = int(sample.element.size());
+    const char* elementStr  = sample.element.data();
+
+    log_trace("processMetric %.*s@%.*s", quantityLen, quantityStr, elementLen, elementStr);
+    bool used = false, measureSent = false;
+
+    // names of devices are interned with the topology
+    auto measurement = [&sample, quantity]() {
+        return Measurement::fromMetric(
+            quantity, sample.element, sample.units, sample.value, sample.timestamp, sample.ttl);
+    };
+
+    // a device can power more units (e.g. UPS)
+    uint32_t device = NameRegistry::elements().find(sample.element);
+
+    for (auto& unitLevel : _levels) {
+        uint32_t mask = quantity::mask(quantity);
+        if ((unitLevel.inputsMask & mask) == 0) {
+            continue;
+        }
+        for (TPUnit* unit : unitLevel.owners.owners(device)) {
+            // the metric affects some total power
+            log_trace("%.*s@%.*s is interesting for %s %s", quantityLen, quantityStr, elementLen, elementStr,
+                s_kindName(unit->kind()), unit->name().c_str());
+
+            unit->setMeasurement(sample.element, measurement()); // register the measure
+            if (_settings.lazyCalculation || _batch) {
+                markPending(unitLevel.pending, *unit); // compute + send once it can be published
+            } else if ((quantity::APPARENT_INPUTS & mask) != 0) {
+                // the phase and the imbalance of phases in one pass
+                Quantity phase = quantity::apparentTotal(quantity);
+                unit->calculate(phase, Quantity::POWER_INPUT_IMBALANCE);
+                markParents(*unit);
+                measureSent |= publishMeasurement(*unit, phase);
+                measureSent |= publishMeasurement(*unit, Quantity::POWER_INPUT_IMBALANCE);
+            } else {
+                measureSent |= sendMeasurement(*unit, quantity); // compute + send conditionally
             }
+            used = true;
         }
     }
 
-    log_trace("processMetric %s was %s (rack measure %s, DC measure %s)", topic.c_str(), (used ? "used" : "ignored"),
-        (rackMeasureSent ? "sent" : "not sent"), (dcMeasureSent ? "sent" : "not sent"));
+    if (!_batch && !_settings.lazyCalculation) {
+        // parents summed from the updated units
+        publishPending();
+    }
+
+    log_trace("processMetric %.*s@%.*s was %s (measure %s)", quantityLen, quantityStr, elementLen, elementStr,
+        (used ? "used" : "ignored"), (measureSent ? "sent" : "not sent"));
 }
 
-bool TotalPowerConfiguration::sendMeasurement(
-    std::pair<const std::string, TPUnit>& element, const std::string& quantity)
+bool TotalPowerConfiguration::sendMeasurement(TPUnit& unit, Quantity quantity)
 {
-    bool isSent = false;
+    // calculate quantity for the unit
+    unit.calculate(quantity);
+    markParents(unit);
+    if (quantity == Quantity::REALPOWER_DEFAULT) {
+        checkThreshold(unit);
+    }
 
-    // renaming for better reading
-    auto& powerUnit = element.second; // TPUnit
+    return publishMeasurement(unit, quantity);
+}
 
-    // calculate quantity for element.first (rack or dc)
-    powerUnit.calculate(quantity);
+bool TotalPowerConfiguration::publishMeasurement(TPUnit& powerUnit, Quantity quantity)
+{
+    bool isSent = false;
 
-    if (powerUnit.advertise(quantity)) {
+    StageTimer decision(Stage::ADVERTISE);
+    bool       advertise = powerUnit.advertise(quantity);
+    decision.stop();
+    if (advertise) {
         try {
-            MetricInfo M = powerUnit.getMetricInfo(quantity);
-            isSent       = _sendingFunction(M);
+            const MetricInfo& M        = powerUnit.getMetricInfo(quantity);
+            bool              periodic = !powerUnit.changed(quantity);
+            isSent                     = _sendingFunction(M);
             if (isSent) {
                 powerUnit.advertised(quantity);
+                _stats.published++;
+                if (quantity == Quantity::REALPOWER_DEFAULT) {
+                    // statistics follow the publishing of the total
+                    publishStatistics(powerUnit);
+                    if (periodic && (powerUnit.thresholdState() != ThresholdState::OK)) {
+                        // keep the active alert alive
+                        sendAlert(powerUnit, powerUnit.thresholdState(), true);
+                    }
+                }
             }
         } catch (...) {
             log_error(ANSI_COLOR_RED "Some unexpected error during sending new measurement" ANSI_COLOR_RESET);
         };
+    } else if (powerUnit.changed(quantity) && powerUnit.throttled(quantity)) {
+        _stats.intervalSuppressed++;
     } else {
         // log something from time to time if device calculation is unknown
         auto devices = powerUnit.devicesInUnknownState(quantity);
@@ -223,23 +663,112 @@ bool TotalPowerConfiguration::sendMeasurement(
             }
 
             log_info(ANSI_COLOR_BOLD "%zd devices preventing total %s calculation for %s: %s" ANSI_COLOR_RESET,
-                devices.size(), quantity.c_str(), element.first.c_str(), aux.c_str());
+                devices.size(), quantity::name(quantity), powerUnit.name().c_str(), aux.c_str());
         }
     }
 
     return isSent;
 }
 
+void TotalPowerConfiguration::publishStatistics(TPUnit& powerUnit)
+{
+    uint64_t now = Clock::now();
+    for (const auto& M : powerUnit.statistics(now)) {
+        if (!std::isnan(M.getValue())) {
+            _sendingFunction(M);
+        }
+    }
+    if (_settings.publishEnergy) {
+        _sendingFunction(powerUnit.energyMetric(now));
+    }
+    if (_settings.publishOldestInput) {
+        const MetricInfo& M = powerUnit.oldestInputMetric(now);
+        if (!std::isnan(M.getValue())) {
+            _sendingFunction(M);
+        }
+    }
+}
+
 void TotalPowerConfiguration::sendMeasurement(
-    std::map<std::string, TPUnit>& elements, const std::vector<std::string>& quantities)
+    std::map<std::string, TPUnit>& elements, const std::vector<Quantity>& quantities)
 {
     for (auto& element : elements) {
         // XXX: This overload is called by onPoll() periodically, hence the purging
         element.second.dropOldMetricInfos();
-        for (auto& quantity : quantities) {
-            sendMeasurement(element, quantity);
+        if (_settings.lazyCalculation && !element.second.advertiseDue(quantities)) {
+            // only periodic republishing is left, changes are handled by publishPending()
+            continue;
+        }
+        element.second.calculate(quantities);
+        markParents(element.second);
+        checkThreshold(element.second);
+        for (auto quantity : quantities) {
+            publishMeasurement(element.second, quantity);
+        }
+    }
+}
+
+void TotalPowerConfiguration::markPending(std::vector<TPUnit*>& pending, TPUnit& unit)
+{
+    if (!unit.dirty()) {
+        unit.dirty(true);
+        pending.push_back(&unit);
+    }
+}
+
+void TotalPowerConfiguration::markParents(const TPUnit& unit)
+{
+    for (TPUnit* parent : unit.parents()) {
+        markPending(level(parent->kind()).pending, *parent);
+    }
+}
+
+void TotalPowerConfiguration::publishPending(UnitLevel& unitLevel)
+{
+    auto&  pending    = unitLevel.pending;
+    auto&  quantities = unitLevel.quantities;
+    size_t kept       = 0;
+    for (auto unit : pending) {
+        if (!unit->dirty()) {
+            // already recalculated by the periodic poll
+            continue;
         }
+        if (_settings.lazyCalculation && (unit->timeToPublishWindow(quantities) > 0)) {
+            // nothing could be published now, try it later
+            pending[kept++] = unit;
+            continue;
+        }
+        unit->calculate(quantities);
+        markParents(*unit);
+        checkThreshold(*unit);
+        for (auto quantity : quantities) {
+            publishMeasurement(*unit, quantity);
+        }
+    }
+    pending.resize(kept);
+}
+
+void TotalPowerConfiguration::publishPending()
+{
+    Clock::Cache clock; // one clock read for all units
+
+    // children first, so parents are summed from the new totals
+    for (auto& unitLevel : _levels) {
+        publishPending(unitLevel);
+    }
+}
+
+MetricInfo TotalPowerConfiguration::query(const std::string& unitName, Quantity quantity)
+{
+    TPUnit* unit = findUnit(unitName);
+    if (!unit) {
+        throw std::runtime_error("Unknown unit " + unitName);
+    }
+    if (unit->dirty()) {
+        // unit stays pending, so the change is published later
+        unit->calculate(quantity);
     }
+    return unit->getMetricInfo(quantity);
 }
 
 int64_t TotalPowerConfiguration::getPollInterval()
@@ -247,24 +776,24 @@ int64_t TotalPowerConfiguration::getPollInterval()
     int64_t T = TPOWER_MEASUREMENT_REPEAT_AFTER; // default, seconds
     int64_t Tx;
 
-    for (auto& rack : _racks) {
-        for (auto& q : _rackQuantities) {
-            Tx = rack.second.timeToAdvertisement(q);
-            if ((Tx > 0) && (Tx < T))
-                T = Tx;
+    for (auto& unitLevel : _levels) {
+        for (auto& unit : unitLevel.units) {
+            for (auto& q : unitLevel.quantities) {
+                Tx = unit.second.timeToAdvertisement(q);
+                if ((Tx > 0) && (Tx < T))
+                    T = Tx;
+            }
         }
-    }
 
-    for (auto& dc : _DCs) {
-        for (auto& q : _dcQuantities) {
-            Tx = dc.second.timeToAdvertisement(q);
+        for (auto unit : unitLevel.pending) {
+            Tx = unit->timeToPublishWindow(unitLevel.quantities);
             if ((Tx > 0) && (Tx < T))
                 T = Tx;
         }
     }
 
     if (_reconfigPending != 0) {
-        Tx = _reconfigPending - ::time(NULL) + 1;
+        Tx = _reconfigPending - int64_t(Clock::now()) + 1;
         if (Tx <= 0)
             Tx = 1;
         if (Tx < T)
@@ -274,15 +803,40 @@ int64_t TotalPowerConfiguration::getPollInterval()
     return T * 1000; // ms
 }
 
+PublishStats TotalPowerConfiguration::publishStats() const
+{
+    PublishStats result = _stats;
+    for (const auto& unitLevel : _levels) {
+        for (const auto& unit : unitLevel.units) {
+            result.deadbandSuppressed += unit.second.deadbandSuppressed();
+            result.calculations += unit.second.calculations();
+        }
+    }
+    return result;
+}
+
 void TotalPowerConfiguration::onPoll()
 {
-    sendMeasurement(_racks, _rackQuantities);
-    sendMeasurement(_DCs, _dcQuantities);
+    Clock::Cache clock; // one clock read for all units
+
+    // children first, so parents are summed from the new totals
+    for (auto& unitLevel : _levels) {
+        publishPending(unitLevel);
+        sendMeasurement(unitLevel.units, unitLevel.quantities);
+    }
+
+    PublishStats stats = publishStats();
+    log_debug("published %" PRIu64 " totals, suppressed %" PRIu64 " by deadband and %" PRIu64 " by interval",
+        stats.published, stats.deadbandSuppressed, stats.intervalSuppressed);
 
-    if ((_reconfigPending != 0) && (_reconfigPending <= ::time(NULL))) {
+    if ((_reconfigPending != 0) && (_reconfigPending <= int64_t(Clock::now()))) {
         configure();
     }
 
+    if (!_settings.stateFile.empty() && (int64_t(Clock::now()) - _stateSaved >= TPOWER_MEASUREMENT_REPEAT_AFTER)) {
+        saveState();
+    }
+
     _timeout = getPollInterval();
 }
 
@@ -290,3 +844,65 @@ void TotalPowerConfiguration::setPollInterval()
 {
     _timeout = getPollInterval();
 }
+
+static const char* SNAPSHOT_SECTIONS[] = {"rack", "dc", "row", "room", "children", "group"};
+
+bool saveTopologySnapshot(
+    const std::string& path, const PowerTopology& racks, const PowerTopology& dcs, const LocationTopology& locations)
+{
+    const PowerTopology* topologies[] = {
+        &racks, &dcs, &locations.rows, &locations.rooms, &locations.children, &locations.groups};
+
+    std::ofstream file(path, std::ios::trunc);
+    for (size_t i = 0; i < sizeof(topologies) / sizeof(topologies[0]); ++i) {
+        for (const auto& unit : *topologies[i]) {
+            file << SNAPSHOT_SECTIONS[i] << '\t' << unit.first;
+            for (const auto& member : unit.second) {
+                file << '\t' << member;
+            }
+            file << '\n';
+        }
+    }
+    file.close();
+    if (!file) {
+        log_error("cannot save topology snapshot to '%s'", path.c_str());
+        return false;
+    }
+    log_debug("topology snapshot saved to '%s'", path.c_str());
+    return true;
+}
+
+bool loadTopologySnapshot(
+    const std::string& path, PowerTopology& racks, PowerTopology& dcs, LocationTopology& locations)
+{
+    PowerTopology* topologies[] = {
+        &racks, &dcs, &locations.rows, &locations.rooms, &locations.children, &locations.groups};
+
+    std::ifstream file(path);
+    if (!file) {
+        log_error("cannot read topology snapshot '%s'", path.c_str());
+        return false;
+    }
+    for (auto* topology : topologies) {
+        topology->clear();
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream       stream(line);
+        std::string              section, unit, member;
+        std::vector<std::string> members;
+        if (!std::getline(stream, section, '\t') || !std::getline(stream, unit, '\t')) {
+            continue;
+        }
+        while (std::getline(stream, member, '\t')) {
+            members.push_back(member);
+        }
+        auto it = std::find(std::begin(SNAPSHOT_SECTIONS), std::end(SNAPSHOT_SECTIONS), section);
+        if (it == std::end(SNAPSHOT_SECTIONS)) {
+            log_warning("unknown section '%s' of topology snapshot ignored", section.c_str());
+            continue;
+        }
+        (*topologies[it - std::begin(SNAPSHOT_SECTIONS)])[unit] = std::move(members);
+    }
+    return true;
+}
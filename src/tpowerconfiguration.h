@@ -25,7 +25,12 @@
 
 #pragma once
 
+#include "clock.h"
+#include "metricfilter.h"
+#include "metricrecord.h"
+#include "ownerindex.h"
 #include "tp_unit.h"
+#include <array>
 #include <fty_proto.h>
 #include <functional>
 #include <map>
@@ -38,6 +43,88 @@
 #define TPOWER_POLLING_INTERVAL 5000
 
 
+/// power topology: rack or DC name -> names of its power devices
+typedef std::map<std::string, std::vector<std::string>> PowerTopology;
+
+/// rows, rooms, groups and the location hierarchy used for the roll-up of totals
+struct LocationTopology
+{
+    /// row name -> names of its power devices
+    PowerTopology rows;
+    /// room name -> names of its power devices
+    PowerTopology rooms;
+    /// DC, room or row name -> names of its direct children (rooms, rows or racks)
+    PowerTopology children;
+    /// group name -> names of its members (racks, rows, rooms, DCs or power devices)
+    PowerTopology groups;
+};
+
+/// save the topology in a text file, line per unit: "<section>\t<unit>\t<member>\t..."
+/// (sections: rack, dc, row, room, children, group)
+///
+/// @return true if the file was written
+bool saveTopologySnapshot(
+    const std::string& path, const PowerTopology& racks, const PowerTopology& dcs, const LocationTopology& locations);
+/// load the topology saved by saveTopologySnapshot
+///
+/// @return true if the file was read
+bool loadTopologySnapshot(
+    const std::string& path, PowerTopology& racks, PowerTopology& dcs, LocationTopology& locations);
+
+/// crossing of a threshold by a total
+struct ThresholdAlert
+{
+    /// unit name
+    std::string unit;
+    /// the total
+    Quantity quantity = Quantity::REALPOWER_DEFAULT;
+    /// crossed limit (HIGH or LOW)
+    ThresholdState limit = ThresholdState::HIGH;
+    /// false if the alert is resolved
+    bool active = false;
+    /// the total
+    double value = 0;
+    /// the limit
+    double threshold = 0;
+    /// [s]
+    uint64_t timestamp = 0;
+};
+
+/// counters of the publishing activity
+struct PublishStats
+{
+    /// totals sent
+    uint64_t published = 0;
+    /// changes of totals hidden by the deadband
+    uint64_t deadbandSuppressed = 0;
+    /// changes of totals delayed by the minimal publishing interval
+    uint64_t intervalSuppressed = 0;
+    /// calculations of units
+    uint64_t calculations = 0;
+};
+
+/// estimated memory used by the topology and measurements
+struct MemoryReport
+{
+    /// power devices (counted once per unit)
+    size_t devices = 0;
+    /// units and their measurements [B]
+    size_t unitsBytes = 0;
+    /// device -> unit maps [B]
+    size_t mapsBytes = 0;
+    /// interned names [B]
+    size_t namesBytes = 0;
+
+    size_t bytes() const
+    {
+        return unitsBytes + mapsBytes + namesBytes;
+    };
+    size_t bytesPerDevice() const
+    {
+        return devices ? bytes() / devices : 0;
+    };
+};
+
 class TotalPowerConfiguration
 {
 public:
@@ -47,18 +134,118 @@ public:
         _sendingFunction = f;
     };
 
-    void processMetric(const MetricInfo& M, const std::string& topic);
+    /// handle new measurement of a device, ignored if it isn't interesting
+    ///
+    /// Steady state (known device of the topology) doesn't allocate.
+    void processMetric(const MetricSample& sample);
+    void processMetric(const MetricInfo& M)
+    {
+        processMetric(MetricSample(M));
+    };
+    /// handle new measurement of a device, quantity was returned by interestingQuantity()
+    void processMetric(const MetricSample& sample, Quantity quantity);
+    /// parsed quantity if the metric is used by some unit, Quantity::UNKNOWN otherwise
+    /// (one hash probe, value is not needed)
+    Quantity interestingQuantity(std::string_view element, std::string_view quantity) const
+    {
+        Quantity parsed = quantity::fromString(quantity);
+        return _filter.contains(element, parsed) ? parsed : Quantity::UNKNOWN;
+    };
+    /// returns true if the metric is used by some unit
+    bool interesting(std::string_view element, std::string_view quantity) const
+    {
+        return interestingQuantity(element, quantity) != Quantity::UNKNOWN;
+    };
     void processAsset(fty_proto_t* message);
     void onPoll();
     void setPollInterval();
+    /// recalculate and publish totals of units updated by metrics (lazy calculation or batch)
+    void publishPending();
+    /// start a batch of metrics, units are recalculated once at the end of the batch
+    ///
+    /// The clock is read once for the whole batch.
+    void beginBatch()
+    {
+        if (!_batch) {
+            Clock::hold();
+        }
+        _batch = true;
+        if (_recorder.isOpen()) {
+            _recorder.beginBatch(Clock::now());
+        }
+    };
+    /// recalculate and publish units updated by the batch
+    void endBatch()
+    {
+        bool held = _batch;
+        _batch    = false;
+        if (_recorder.isOpen()) {
+            _recorder.endBatch();
+        }
+        publishPending();
+        if (held) {
+            Clock::release();
+        }
+    };
+    /// current value of the total, recalculated first if it's not up to date
+    ///
+    /// Method throws an exception if the unit or the total is unknown.
+    MetricInfo query(const std::string& unitName, Quantity quantity);
     /// read configuration from database
     bool configure();
+    /// replace the topology of racks, DCs and optionally rows, rooms and groups
+    ///
+    /// A parent of the location hierarchy is summed from its children when
+    /// the children are powered by exactly the power devices of the parent
+    /// (no device is shared or missing), otherwise it's summed from the devices.
+    /// A group is a parent of its members the same way, so groups of units are
+    /// updated from the totals of their members, not by rescanning the devices.
+    void loadTopology(const PowerTopology& racks, const PowerTopology& dcs, const LocationTopology& locations = {});
 
     /// in[ms]
     int64_t getTimeout(void)
     {
         return _timeout;
     };
+    /// calculete polling interval (not to wake up every 5s) [ms]
+    int64_t getPollInterval();
+
+    /// set function sending alerts of thresholds
+    void alertFunction(std::function<bool(const ThresholdAlert&)> f)
+    {
+        _alertFunction = f;
+    };
+
+    /// metrics are recorded (see TPowerSettings::recordFile)
+    bool recording() const
+    {
+        return _recorder.isOpen();
+    };
+    /// add metric read from shm to the recorded batch (all metrics are recorded, not only the interesting ones)
+    void record(const MetricSample& sample)
+    {
+        _recorder.add(sample);
+    };
+
+    /// replace the settings (deadbands, publishing interval, groups)
+    ///
+    /// Topology is reloaded on the next poll if the groups changed.
+    void settings(const TPowerSettings& settings);
+
+    /// publishing counters
+    PublishStats publishStats() const;
+
+    /// estimated memory used by the topology and measurements
+    MemoryReport memoryReport() const;
+
+    /// save energy counters to the state file of the settings
+    ///
+    /// @return true if the file was written
+    bool saveState();
+    /// load energy counters, units loaded later get them too
+    ///
+    /// @return true if the file was loaded
+    bool loadState(const std::string& path);
 
 private:
     /// Function that is responsible for sending the message
@@ -66,47 +253,125 @@ private:
     /// @return true is metric was sent successfully
     std::function<bool(const MetricInfo&)> _sendingFunction;
 
+    /// function sending alerts of thresholds, may be empty
+    std::function<bool(const ThresholdAlert&)> _alertFunction;
+
     /// in [ms]
     int64_t _timeout;
-    /// list of racks
-    std::map<std::string, TPUnit> _racks;
-    /// list of interested units
-    const std::vector<std::string> _rackQuantities = {
-        "realpower.default",
-    };
-    bool isRackQuantity(const std::string& quantity) const;
-    /// list of racks, affected by powerdevice
-    std::map<std::string, std::string> _affectedRacks;
-
-    /// list of datacenters
-    std::map<std::string, TPUnit> _DCs;
-    /// list of interested units
-    const std::vector<std::string> _dcQuantities = {
-        "realpower.default",
-        "realpower.input.L1",
-        "realpower.input.L2",
-        "realpower.input.L3",
-        "realpower.output.L1",
-        "realpower.output.L2",
-        "realpower.output.L3",
-    };
-    bool isDCQuantity(const std::string& quantity) const;
-    /// list of DCs, affected by powerdevice
-    std::map<std::string, std::string> _affectedDCs;
+
+    /// settings shared by all units
+    TPowerSettings _settings;
+
+    /// publishing counters (deadband suppression is counted by units)
+    PublishStats _stats;
+    /// bit mask of quantities
+    static uint32_t quantitiesMask(const std::vector<Quantity>& quantities)
+    {
+        uint32_t result = 0;
+        for (auto quantity : quantities) {
+            result |= quantity::mask(quantity);
+        }
+        return result;
+    };
+
+    /// units of one kind
+    struct UnitLevel
+    {
+        /// units by name
+        std::map<std::string, TPUnit> units;
+        /// list of interested quantities (TPUnit computes them in one pass)
+        std::vector<Quantity> quantities;
+        /// bit mask of interested quantities
+        uint32_t quantitiesMask = 0;
+        /// bit mask of measurements used by the totals
+        uint32_t inputsMask = 0;
+        /// units affected by powerdevice (units summed from the children only are not included)
+        OwnerIndex owners;
+        /// units with new measurements waiting for calculation (lazy calculation, batch or roll-up)
+        std::vector<TPUnit*> pending;
+
+        UnitLevel(std::vector<Quantity> q = {}, const std::vector<Quantity>& inputs = {})
+            : quantities(std::move(q))
+            , quantitiesMask(TotalPowerConfiguration::quantitiesMask(quantities))
+            , inputsMask(quantitiesMask | TotalPowerConfiguration::quantitiesMask(inputs)){};
+    };
+
+    /// racks, rows, rooms, DCs and groups indexed by TPUnitKind (children are calculated before parents)
+    std::array<UnitLevel, UNIT_KIND_COUNT> _levels = {
+        UnitLevel({Quantity::REALPOWER_DEFAULT}), // racks
+        UnitLevel({Quantity::REALPOWER_DEFAULT}), // rows
+        UnitLevel({Quantity::REALPOWER_DEFAULT}), // rooms
+        UnitLevel({
+            Quantity::REALPOWER_DEFAULT,
+            Quantity::REALPOWER_INPUT_L1,
+            Quantity::REALPOWER_INPUT_L2,
+            Quantity::REALPOWER_INPUT_L3,
+            Quantity::REALPOWER_OUTPUT_L1,
+            Quantity::REALPOWER_OUTPUT_L2,
+            Quantity::REALPOWER_OUTPUT_L3,
+            Quantity::POWER_INPUT_L1,
+            Quantity::POWER_INPUT_L2,
+            Quantity::POWER_INPUT_L3,
+            Quantity::POWER_INPUT_IMBALANCE,
+        },
+            {Quantity::CURRENT_INPUT_L1, Quantity::CURRENT_INPUT_L2, Quantity::CURRENT_INPUT_L3,
+                Quantity::VOLTAGE_INPUT_L1, Quantity::VOLTAGE_INPUT_L2,
+                Quantity::VOLTAGE_INPUT_L3}),     // DCs, apparent power of phases is V x I if not measured
+        UnitLevel({Quantity::REALPOWER_DEFAULT}), // groups
+    };
+
+    UnitLevel& level(TPUnitKind kind)
+    {
+        return _levels[size_t(kind)];
+    };
+
+    /// unit of any kind, nullptr if unknown
+    TPUnit* findUnit(const std::string& name);
+
+    /// interesting (device, quantity) pairs of all units
+    MetricFilter _filter;
 
     /// timestamp, when we should re-read configuration
     int64_t _reconfigPending = 0;
 
+    /// metrics are processed in a batch
+    bool _batch = false;
+
+    /// energy counters [Wh] restored from the state file or kept over the topology reload
+    std::map<std::string, double> _energyState;
+    /// timestamp, when the state was saved
+    int64_t _stateSaved = 0;
+
+    /// record of metric batches, the topology snapshot is saved next to it
+    MetricRecorder _recorder;
 
     /// send measurement message if needed
-    void sendMeasurement(std::map<std::string, TPUnit>& elements, const std::vector<std::string>& quantities);
-    /// send measurement message for a single unit if needed
-    bool sendMeasurement(std::pair<const std::string, TPUnit>& element, const std::string& quantity);
+    void sendMeasurement(std::map<std::string, TPUnit>& elements, const std::vector<Quantity>& quantities);
+    /// send measurement message for a single unit if needed, parents are marked for the calculation
+    bool sendMeasurement(TPUnit& unit, Quantity quantity);
+    /// send already calculated measurement if needed
+    bool publishMeasurement(TPUnit& powerUnit, Quantity quantity);
+    /// compare the recalculated total with the thresholds, send alerts on crossing
+    void checkThreshold(TPUnit& unit);
+    /// send (or resolve) alert of the unit
+    void sendAlert(const TPUnit& unit, ThresholdState limit, bool active);
+    /// set thresholds of the settings to units
+    void assignThresholds();
+    /// send rolling statistics, energy and the oldest input of the unit
+    void publishStatistics(TPUnit& powerUnit);
 
-    /// powerdevice to DC or rack and put it also in _affected* map
-    void addDeviceToMap(std::map<std::string, TPUnit>& elements, std::map<std::string, std::string>& reverseMap,
-        const std::string& owner, const std::string& device);
+    /// mark unit as dirty and remember it for the calculation
+    void markPending(std::vector<TPUnit*>& pending, TPUnit& unit);
+    /// mark parents of the recalculated unit for the calculation
+    void markParents(const TPUnit& unit);
+    /// calculate and send dirty units, keep those which can't be published yet
+    void publishPending(UnitLevel& level);
 
-    /// calculete polling interval (not to wake up every 5s)
-    int64_t getPollInterval();
+    /// powerdevice to unit of the kind
+    void addDeviceToMap(const std::string& owner, const std::string& device, TPUnitKind kind);
+    /// sum the parent from the children if they are powered by the same devices
+    void addRollup(const std::string& parent, const std::vector<std::string>& children,
+        const std::array<const PowerTopology*, UNIT_KIND_COUNT>& topologies);
+    /// put devices of units in the owners index and the filter
+    void routeDevices(const PowerTopology& topology, TPUnitKind kind);
 };
@@ -0,0 +1,218 @@
+/*  =========================================================================
+    tpowersettings - Agent settings
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#include "tpowersettings.h"
+#include "rollingwindow.h"
+#include "tpowerconfiguration.h"
+#include <cctype>
+#include <cinttypes>
+#include <cmath>
+#include <cstdlib>
+#include <czmq.h>
+#include <fty_log.h>
+#include <stdexcept>
+
+bool Deadband::exceeded(double lastValue, double newValue) const
+{
+    double difference = std::fabs(newValue - lastValue);
+    return (difference > absolute) && (difference > std::fabs(lastValue) * relative / 100.0);
+}
+
+ThresholdState Threshold::evaluate(ThresholdState state, double value) const
+{
+    if (std::isnan(value)) {
+        return state;
+    }
+    // active alert stays until the total is back by the hysteresis
+    if ((state == ThresholdState::HIGH) && (value > high - hysteresis)) {
+        return state;
+    }
+    if ((state == ThresholdState::LOW) && (value < low + hysteresis)) {
+        return state;
+    }
+    if (value > high) {
+        return ThresholdState::HIGH;
+    }
+    if (value < low) {
+        return ThresholdState::LOW;
+    }
+    return ThresholdState::OK;
+}
+
+/// read a non negative number from the configuration, keep defaultValue if not present or invalid
+static double s_getNumber(zconfig_t* config, const char* path, double defaultValue)
+{
+    const char* value = zconfig_get(config, path, nullptr);
+    if (!value) {
+        return defaultValue;
+    }
+    try {
+        double result = std::stod(value);
+        if (result >= 0) {
+            return result;
+        }
+    } catch (const std::exception&) {
+    }
+    log_warning("invalid value '%s' of '%s', using %f", value, path, defaultValue);
+    return defaultValue;
+}
+
+/// split list of names separated by commas or spaces
+static std::vector<std::string> s_getList(const char* value)
+{
+    std::vector<std::string> result;
+    std::string              name;
+    for (const char* c = value; c && *c; ++c) {
+        if ((*c == ',') || std::isspace(static_cast<unsigned char>(*c))) {
+            if (!name.empty()) {
+                result.push_back(name);
+                name.clear();
+            }
+        } else {
+            name += *c;
+        }
+    }
+    if (!name.empty()) {
+        result.push_back(name);
+    }
+    return result;
+}
+
+/// read deadband from the configuration section
+static Deadband s_getDeadband(zconfig_t* section, const Deadband& defaultDeadband)
+{
+    Deadband result;
+    result.absolute = s_getNumber(section, "absolute", defaultDeadband.absolute);
+    result.relative = s_getNumber(section, "relative", defaultDeadband.relative);
+    return result;
+}
+
+bool TPowerSettings::load(const std::string& path)
+{
+    zconfig_t* config = zconfig_load(path.c_str());
+    if (!config) {
+        log_error("cannot load configuration file '%s'", path.c_str());
+        return false;
+    }
+
+    double interval = s_getNumber(config, "publish/min_interval", double(minPublishInterval));
+    if (interval >= TPOWER_MEASUREMENT_REPEAT_AFTER) {
+        // the periodic republishing must not be blocked
+        log_warning("publish/min_interval %f is too high, using %d", interval, TPOWER_MEASUREMENT_REPEAT_AFTER - 1);
+        interval = TPOWER_MEASUREMENT_REPEAT_AFTER - 1;
+    }
+    minPublishInterval = uint64_t(interval);
+
+    lazyCalculation = s_getNumber(config, "calculation/lazy", lazyCalculation ? 1 : 0) != 0;
+
+    Deadband   defaultDeadband;
+    size_t     overrides = 0;
+    zconfig_t* section   = zconfig_locate(config, "publish/deadband");
+    if (section) {
+        defaultDeadband = s_getDeadband(section, defaultDeadband);
+    }
+    deadbands.fill(defaultDeadband);
+    if (section) {
+        // subsections are quantity specific deadbands
+        for (zconfig_t* child = zconfig_child(section); child; child = zconfig_next(child)) {
+            if (!zconfig_child(child)) {
+                continue;
+            }
+            Quantity quantity = quantity::fromString(zconfig_name(child));
+            if (quantity == Quantity::UNKNOWN) {
+                log_warning("deadband of unknown quantity '%s' ignored", zconfig_name(child));
+                continue;
+            }
+            deadband(quantity) = s_getDeadband(child, defaultDeadband);
+            overrides++;
+        }
+    }
+
+    groupAttributes = s_getList(zconfig_get(config, "groups/attributes", nullptr));
+    groups.clear();
+    zconfig_t* members = zconfig_locate(config, "groups/members");
+    if (members) {
+        // group name = list of members
+        for (zconfig_t* child = zconfig_child(members); child; child = zconfig_next(child)) {
+            auto list = s_getList(zconfig_value(child));
+            if (list.empty()) {
+                log_warning("group '%s' has no members", zconfig_name(child));
+                continue;
+            }
+            groups[zconfig_name(child)] = list;
+        }
+    }
+
+    publishEnergy = s_getNumber(config, "energy/publish", publishEnergy ? 1 : 0) != 0;
+    stateFile     = zconfig_get(config, "energy/state_file", "");
+    recordFile    = zconfig_get(config, "record/file", "");
+    statsEnabled  = s_getNumber(config, "stats/enabled", statsEnabled ? 1 : 0) != 0;
+    traceFile     = zconfig_get(config, "trace/file", traceFile.c_str());
+
+    for (size_t i = 0; i < HEARTBEAT_COUNT; ++i) {
+        std::string key   = std::string("watchdog/") + Watchdog::name(Heartbeat(i));
+        watchdogLimits[i] = uint32_t(s_getNumber(config, key.c_str(), watchdogLimits[i]));
+    }
+
+    stalenessStatistics = s_getNumber(config, "staleness/statistics", stalenessStatistics ? 1 : 0) != 0;
+    publishOldestInput  = s_getNumber(config, "staleness/oldest_input", publishOldestInput ? 1 : 0) != 0;
+
+    thresholds.clear();
+    zconfig_t* limits = zconfig_locate(config, "thresholds");
+    for (zconfig_t* child = limits ? zconfig_child(limits) : nullptr; child; child = zconfig_next(child)) {
+        // unit name: high, low, hysteresis
+        Threshold threshold;
+        threshold.high       = s_getNumber(child, "high", threshold.high);
+        threshold.low        = s_getNumber(child, "low", threshold.low);
+        threshold.hysteresis = s_getNumber(child, "hysteresis", threshold.hysteresis);
+        if (std::isnan(threshold.high) && std::isnan(threshold.low)) {
+            log_warning("thresholds of '%s' have no limits", zconfig_name(child));
+            continue;
+        }
+        thresholds[zconfig_name(child)] = threshold;
+    }
+
+    statisticWindows.clear();
+    for (const auto& window : s_getList(zconfig_get(config, "statistics/windows", nullptr))) {
+        char*         end     = nullptr;
+        unsigned long seconds = std::strtoul(window.c_str(), &end, 10);
+        if ((*end != '\0') || (seconds == 0) || (seconds > 24 * 3600)) {
+            log_warning("invalid statistics window '%s' ignored", window.c_str());
+            continue;
+        }
+        if (RollingWindow::rounded(uint32_t(seconds)) != seconds) {
+            log_warning("statistics window %lus isn't a multiple of %us, rounded to %us", seconds,
+                RollingWindow::BUCKETS, RollingWindow::rounded(uint32_t(seconds)));
+            seconds = RollingWindow::rounded(uint32_t(seconds));
+        }
+        statisticWindows.push_back(uint32_t(seconds));
+    }
+
+    log_info("settings loaded from '%s' (deadband: %f/%f%%, quantity deadbands: %zu, min publish interval: %" PRIu64
+             "s, lazy calculation: %s, static groups: %zu, group attributes: %zu, "
+             "statistic windows: %zu, thresholds: %zu)",
+        path.c_str(), defaultDeadband.absolute, defaultDeadband.relative, overrides, minPublishInterval,
+        lazyCalculation ? "yes" : "no", groups.size(), groupAttributes.size(),
+        statisticWindows.size(), thresholds.size());
+
+    zconfig_destroy(&config);
+    return true;
+}
@@ -0,0 +1,135 @@
+/*  =========================================================================
+    tpowersettings - Agent settings
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// @file   tpowersettings.h
+/// @brief  Settings of the agent read from the configuration file
+
+#pragma once
+
+#include "quantity.h"
+#include "watchdog.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/// Deadband applied to a computed total before it is reported as changed
+///
+/// The new total is compared with the last reported one. It is considered
+/// changed only if the difference exceeds both the absolute and the relative
+/// deadband.
+struct Deadband
+{
+    /// minimal absolute difference (in units of the quantity)
+    double absolute = 0.00001;
+    /// minimal difference relative to the last reported value [%]
+    double relative = 0;
+
+    /// returns true if newValue differs enough from lastValue
+    bool exceeded(double lastValue, double newValue) const;
+};
+
+/// state of a total against its thresholds
+enum class ThresholdState : uint8_t
+{
+    OK,   ///< within the limits
+    HIGH, ///< above the high limit
+    LOW,  ///< below the low limit
+};
+
+/// High and low limits of a total with hysteresis
+struct Threshold
+{
+    /// alert when the total exceeds it, NAN if not checked
+    double high = std::nan("");
+    /// alert when the total falls below it, NAN if not checked
+    double low = std::nan("");
+    /// alert is resolved once the total returns within the limit by this margin
+    double hysteresis = 0;
+
+    /// next state for the new total, unknown total keeps the state
+    ThresholdState evaluate(ThresholdState state, double value) const;
+};
+
+/// Settings of the total power computation
+class TPowerSettings
+{
+public:
+    /// per quantity deadbands, indexed by Quantity
+    std::array<Deadband, QUANTITY_COUNT> deadbands;
+
+    /// minimal interval between two publications of the same total [s]
+    uint64_t minPublishInterval = 0;
+
+    /// metrics only mark units as dirty, totals are calculated once they can be published
+    bool lazyCalculation = false;
+
+    /// static groups: group name -> names of members (racks, rows, rooms, DCs or power devices)
+    std::map<std::string, std::vector<std::string>> groups;
+    /// asset ext attributes defining groups, asset with 'tenant' = 'acme' is a member of 'tenant:acme'
+    std::vector<std::string> groupAttributes;
+
+    /// windows of rolling statistics of realpower.default [s], no statistics if empty
+    std::vector<uint32_t> statisticWindows;
+
+    /// publish average and maximum of publish lag and input age of realpower.default per statistic window
+    bool stalenessStatistics = false;
+    /// publish realpower.default.oldest_input (timestamp of the oldest input) together with the total
+    bool publishOldestInput = false;
+
+    /// thresholds of realpower.default: unit name -> limits
+    std::map<std::string, Threshold> thresholds;
+
+    /// publish energy.default integrated from realpower.default
+    bool publishEnergy = false;
+    /// file keeping energy counters over restarts, not persisted if empty
+    std::string stateFile;
+
+    /// measure latencies of the processing stages (STATS request, SIGUSR1 dump)
+    bool statsEnabled = true;
+
+    /// file written by TRACE DUMP request (Chrome trace JSON), DUMP is refused if empty
+    std::string traceFile;
+
+    /// limits of the pipeline stages without a heartbeat [s], 0 if the stage isn't checked
+    WatchdogLimits watchdogLimits = Watchdog::DEFAULT_LIMITS;
+
+    /// file recording metric batches read from shm for the replay, not recorded if empty
+    std::string recordFile;
+
+    /// returns the deadband for the quantity
+    const Deadband& deadband(Quantity quantity) const
+    {
+        return deadbands[size_t(quantity)];
+    };
+    Deadband& deadband(Quantity quantity)
+    {
+        return deadbands[size_t(quantity)];
+    };
+
+    /// load settings from the configuration file
+    ///
+    /// @param[in] path - path to the zconfig file
+    /// @return true if the file was loaded
+    bool load(const std::string& path);
+};
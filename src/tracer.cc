@@ -0,0 +1,215 @@
+/*  =========================================================================
+    tracer - Chrome trace-event recorder of processing spans
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#include "tracer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+std::atomic<bool> Tracer::s_enabled{false};
+
+namespace {
+
+struct Event
+{
+    /// index of the event + 1, 0 while the event is written
+    std::atomic<uint64_t> sequence{0};
+    const char*           name     = nullptr;
+    const char*           category = nullptr;
+    uint64_t              start    = 0; ///< [ns]
+    uint64_t              duration = 0; ///< [ns]
+    char                  detail[48] = {};
+};
+
+/// ring buffer of a thread, written by the thread only
+struct ThreadBuffer
+{
+    uint32_t                 tid = 0;
+    std::string              name;
+    std::atomic<uint64_t>    head{0};    ///< index of the next event
+    std::atomic<uint64_t>    cleared{0}; ///< events before the index were dropped
+    std::unique_ptr<Event[]> events{new Event[Tracer::CAPACITY]};
+};
+
+/// buffers of all threads (kept after the thread ended)
+std::mutex                                 s_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> s_buffers;
+
+thread_local ThreadBuffer* t_buffer = nullptr;
+thread_local std::string   t_name;
+
+ThreadBuffer& s_buffer()
+{
+    if (!t_buffer) {
+        auto                        buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(s_mutex);
+        buffer->tid  = uint32_t(s_buffers.size() + 1);
+        buffer->name = t_name.empty() ? "thread-" + std::to_string(buffer->tid) : t_name;
+        s_buffers.push_back(buffer);
+        t_buffer = buffer.get();
+    }
+    return *t_buffer;
+}
+
+void s_escape(std::string& out, const char* s)
+{
+    for (; *s; ++s) {
+        char c = *s;
+        if ((c == '"') || (c == '\\')) {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            out += code;
+        } else {
+            out += c;
+        }
+    }
+}
+
+} // namespace
+
+void Tracer::threadName(const char* name)
+{
+    t_name = name;
+    if (t_buffer) {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        t_buffer->name = name;
+    }
+}
+
+uint64_t Tracer::now()
+{
+    return uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+void Tracer::record(const char* name, const char* category, uint64_t start, uint64_t end, const char* detail)
+{
+    ThreadBuffer& buffer = s_buffer();
+    uint64_t      index  = buffer.head.load(std::memory_order_relaxed);
+    Event&        event  = buffer.events[index % CAPACITY];
+
+    // readers skip the event until its sequence is set
+    event.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name     = name;
+    event.category = category;
+    event.start    = start;
+    event.duration = (end > start) ? end - start : 0;
+    if (detail) {
+        strncpy(event.detail, detail, sizeof(event.detail) - 1);
+        event.detail[sizeof(event.detail) - 1] = '\0';
+    } else {
+        event.detail[0] = '\0';
+    }
+    event.sequence.store(index + 1, std::memory_order_release);
+    buffer.head.store(index + 1, std::memory_order_release);
+}
+
+std::string Tracer::json()
+{
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::vector<std::string>                   names;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        buffers = s_buffers;
+        for (const auto& buffer : buffers) {
+            names.push_back(buffer->name);
+        }
+    }
+
+    std::string out = "{\"traceEvents\":[\n";
+    char        line[256];
+    bool        first = true;
+    int         pid   = int(getpid());
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        ThreadBuffer& buffer = *buffers[i];
+
+        snprintf(line, sizeof(line),
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"",
+            first ? "" : ",\n", pid, buffer.tid);
+        out += line;
+        s_escape(out, names[i].c_str());
+        out += "\"}}";
+        first = false;
+
+        uint64_t head   = buffer.head.load(std::memory_order_acquire);
+        uint64_t oldest = (head > CAPACITY) ? head - CAPACITY : 0;
+        uint64_t begin  = std::max(buffer.cleared.load(std::memory_order_relaxed), oldest);
+        for (uint64_t index = begin; index < head; ++index) {
+            const Event& event = buffer.events[index % CAPACITY];
+            if (event.sequence.load(std::memory_order_acquire) != index + 1) {
+                continue; // overwritten meanwhile
+            }
+            const char* name     = event.name;
+            const char* category = event.category;
+            uint64_t    start    = event.start;
+            uint64_t    duration = event.duration;
+            char        detail[sizeof(event.detail)];
+            memcpy(detail, event.detail, sizeof(detail));
+            detail[sizeof(detail) - 1] = '\0';
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (event.sequence.load(std::memory_order_relaxed) != index + 1) {
+                continue;
+            }
+
+            snprintf(line, sizeof(line),
+                ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u",
+                name, category, double(start) / 1000, double(duration) / 1000, pid, buffer.tid);
+            out += line;
+            if (detail[0] != '\0') {
+                out += ",\"args\":{\"detail\":\"";
+                s_escape(out, detail);
+                out += "\"}";
+            }
+            out += "}";
+        }
+    }
+    out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return out;
+}
+
+bool Tracer::write(const std::string& path)
+{
+    std::string   content = json();
+    std::ofstream file(path, std::ios::trunc);
+    file << content;
+    file.close();
+    return bool(file);
+}
+
+void Tracer::clear()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (auto& buffer : s_buffers) {
+        buffer->cleared.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
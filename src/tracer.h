@@ -0,0 +1,113 @@
+/*  =========================================================================
+    tracer - Chrome trace-event recorder of processing spans
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+/// @file   tracer.h
+/// @brief  Chrome trace-event recorder of processing spans (TRACE request)
+///
+/// Spans are kept in a ring buffer of each thread and written as Chrome trace JSON
+/// on demand, the file opens in Perfetto (ui.perfetto.dev) or chrome://tracing.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// Recorder of spans of all threads
+///
+/// Recording is lock free, each thread writes its own ring buffer (the oldest spans are
+/// overwritten), buffers are allocated on the first span of the thread.
+class Tracer
+{
+public:
+    /// spans kept per thread
+    static constexpr size_t CAPACITY = 16384;
+
+    /// start or stop recording
+    static void enable(bool enabled)
+    {
+        s_enabled.store(enabled, std::memory_order_relaxed);
+    };
+    static bool enabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    };
+
+    /// name of the calling thread in the trace
+    static void threadName(const char* name);
+
+    /// monotonic time [ns]
+    static uint64_t now();
+    /// record span of the calling thread, the detail is copied (truncated to 47 characters)
+    static void record(const char* name, const char* category, uint64_t start, uint64_t end, const char* detail);
+
+    /// recorded spans of all threads as Chrome trace JSON
+    static std::string json();
+    /// write json() to the file
+    ///
+    /// @return false if the file can't be written
+    static bool write(const std::string& path);
+    /// drop recorded spans
+    static void clear();
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+/// Span of the scope, recorded only if the tracer is enabled
+///
+/// Name and category must be string literals.
+class TraceSpan
+{
+public:
+    TraceSpan(const char* name, const char* category, const char* detail = nullptr)
+    {
+        if (Tracer::enabled()) {
+            _name     = name;
+            _category = category;
+            _detail   = detail;
+            _start    = Tracer::now();
+        }
+    };
+    ~TraceSpan()
+    {
+        stop();
+    };
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    /// record the span now instead of at the end of the scope
+    void stop()
+    {
+        if (_name) {
+            Tracer::record(_name, _category, _start, Tracer::now(), _detail);
+            _name = nullptr;
+        }
+    };
+
+private:
+    const char* _name     = nullptr;
+    const char* _category = nullptr;
+    const char* _detail   = nullptr;
+    uint64_t    _start    = 0;
+};
@@ -20,62 +20,135 @@
 */
 
 #include "watchdog.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <csignal>
 #include <fty_log.h>
-
-#define WATCHDOG_INTERVAL 60
-#define WATCHDOG_LIMIT    600
+#include <unistd.h>
 
 Watchdog::Watchdog()
-    : thread_(0)
 {
+    for (size_t i = 0; i < HEARTBEAT_COUNT; ++i) {
+        _beats[i].store(0);
+        _limits[i].store(DEFAULT_LIMITS[i]);
+    }
 }
 
 Watchdog::~Watchdog()
 {
-    zactor_destroy(&thread_);
+    stop();
 }
 
-static void watchdog_thread(zsock_t* pipe, void* args)
+uint64_t Watchdog::now()
 {
-    Watchdog* wd = static_cast<Watchdog*>(args);
-
-    zsock_signal(pipe, 0);
-    zpoller_t* poller = zpoller_new(pipe, NULL);
-    while (!zsys_interrupted) {
-        void* which = zpoller_wait(poller, WATCHDOG_INTERVAL);
-        if (which == pipe) {
-            zmsg_t* msg = zmsg_recv(pipe);
-            char*   cmd = zmsg_popstr(msg);
-            if (streq(cmd, "$TERM")) {
-                zstr_free(&cmd);
-                zmsg_destroy(&msg);
-                break;
-            }
-            zstr_free(&cmd);
-            zmsg_destroy(&msg);
-            wd->tick();
-        } else if (wd->check()) {
-            continue;
-        }
-        log_error("watchdog expired");
-
-        int rv = kill(getpid(), SIGTERM);
-        zclock_sleep(1000);
+    return uint64_t(
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
 
-        if (rv != 0)
-            rv = kill(getpid(), SIGKILL);
+const char* Watchdog::name(Heartbeat stage)
+{
+    switch (stage) {
+        case Heartbeat::MLM:
+            return "mlm";
+        case Heartbeat::SHM_POLL:
+            return "shm_poll";
+        case Heartbeat::CALCULATION:
+            return "calculation";
+        case Heartbeat::PUBLISH:
+            return "publish";
     }
-    zpoller_destroy(&poller);
+    return "unknown";
 }
 
 void Watchdog::start()
 {
-    tick();
-    thread_ = zactor_new(watchdog_thread, this);
-    assert(thread_);
+    for (size_t i = 0; i < HEARTBEAT_COUNT; ++i) {
+        beat(Heartbeat(i));
+    }
+    _stopped = false;
+    _thread  = std::thread(&Watchdog::run, this);
+}
+
+void Watchdog::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+    }
+    _wakeup.notify_all();
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+void Watchdog::limits(const WatchdogLimits& limits)
+{
+    for (size_t i = 0; i < HEARTBEAT_COUNT; ++i) {
+        _limits[i].store(limits[i], std::memory_order_relaxed);
+    }
+    // the interval may be shorter now
+    _wakeup.notify_all();
+}
+
+uint64_t Watchdog::lag(Heartbeat stage, uint64_t now) const
+{
+    uint64_t last = _beats[size_t(stage)].load(std::memory_order_relaxed);
+    return (now > last) ? now - last : 0;
 }
 
-bool Watchdog::check()
+size_t Watchdog::check(uint64_t now) const
 {
-    return last_tick_.load() + WATCHDOG_LIMIT > zclock_mono() / 1000;
+    for (size_t i = 0; i < HEARTBEAT_COUNT; ++i) {
+        uint32_t limit = _limits[i].load(std::memory_order_relaxed);
+        if ((limit != 0) && (lag(Heartbeat(i), now) > limit)) {
+            return i;
+        }
+    }
+    return HEARTBEAT_COUNT;
+}
+
+int64_t Watchdog::interval() const
+{
+    int64_t result = INTERVAL;
+    for (const auto& limit : _limits) {
+        uint32_t seconds = limit.load(std::memory_order_relaxed);
+        if (seconds != 0) {
+            result = std::min(result, int64_t(seconds) * 1000 / 2);
+        }
+    }
+    return std::max<int64_t>(result, 1000);
+}
+
+void Watchdog::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stopped) {
+        _wakeup.wait_for(lock, std::chrono::milliseconds(interval()));
+        if (_stopped) {
+            break;
+        }
+        uint64_t time  = now();
+        size_t   stage = check(time);
+        if (stage < HEARTBEAT_COUNT) {
+            expired(Heartbeat(stage), lag(Heartbeat(stage), time), lock);
+            return;
+        }
+    }
+}
+
+void Watchdog::expired(Heartbeat stage, uint64_t lag, std::unique_lock<std::mutex>& lock)
+{
+    log_error("watchdog expired: no %s heartbeat for %" PRIu64 " s (limit %u s)", name(stage), lag, limit(stage));
+
+    int rv = kill(getpid(), SIGTERM);
+
+    // orderly shutdown stops the watchdog, a stuck one doesn't
+    if ((rv == 0) && _wakeup.wait_for(lock, std::chrono::seconds(GRACE), [this]() {
+            return _stopped;
+        })) {
+        return;
+    }
+    log_error("watchdog: the agent didn't terminate, killing it");
+    kill(getpid(), SIGKILL);
 }
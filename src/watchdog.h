@@ -21,24 +21,93 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
-#include <czmq.h>
-#include <sys/types.h>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
 
-/// Band-aid for malamute going AWOL
+/// stages of the processing pipeline monitored by the watchdog
+enum class Heartbeat : uint8_t
+{
+    MLM,         ///< malamute client connected (checked every minute) or a message received
+    SHM_POLL,    ///< read of metrics from shm completed
+    CALCULATION, ///< periodic poll of the configuration completed
+    PUBLISH,     ///< total written to shm
+};
+static const size_t HEARTBEAT_COUNT = size_t(Heartbeat::PUBLISH) + 1;
+
+/// limits of stages without a heartbeat [s], indexed by Heartbeat, 0 if the stage isn't checked
+using WatchdogLimits = std::array<uint32_t, HEARTBEAT_COUNT>;
+
+/// Liveness monitor of the processing pipeline
+///
+/// Each stage beats when it completes. The watchdog thread wakes up every INTERVAL
+/// (or a half of the smallest limit) and terminates the process if a stage didn't beat
+/// within its limit: SIGTERM first, SIGKILL when the process is still alive after
+/// the grace period (the event loop is stuck and can't shut down).
 class Watchdog
 {
 public:
+    /// the biggest interval of checks [ms]
+    static constexpr int INTERVAL = 60 * 1000;
+    /// time to terminate after SIGTERM [s]
+    static constexpr uint64_t GRACE = 30;
+    /// malamute as the old watchdog, shm and calculation with a margin over their periods
+    /// (polling interval of fty-shm, republishing every 5 minutes), publishing isn't checked
+    static constexpr WatchdogLimits DEFAULT_LIMITS = {{600, 600, 900, 0}};
+
     Watchdog();
     ~Watchdog();
+    Watchdog(const Watchdog&) = delete;
+    Watchdog& operator=(const Watchdog&) = delete;
+
+    /// beat all stages and start the thread
     void start();
-    void tick()
+    /// stop the thread (orderly shutdown)
+    void stop();
+
+    void beat(Heartbeat stage)
+    {
+        _beats[size_t(stage)].store(now(), std::memory_order_relaxed);
+    }
+
+    /// set limits [s], 0 disables the check of the stage
+    void limits(const WatchdogLimits& limits);
+    uint32_t limit(Heartbeat stage) const
     {
-        last_tick_.store(zclock_mono() / 1000);
+        return _limits[size_t(stage)].load(std::memory_order_relaxed);
     }
-    bool check();
+
+    /// time since the last beat of the stage [s]
+    uint64_t lag(Heartbeat stage, uint64_t now) const;
+    uint64_t lag(Heartbeat stage) const
+    {
+        return lag(stage, now());
+    }
+
+    /// the first stage over its limit at the time, HEARTBEAT_COUNT if all stages are alive
+    size_t check(uint64_t now) const;
+
+    /// 'mlm', 'shm_poll', ...
+    static const char* name(Heartbeat stage);
+
+    /// monotonic time [s]
+    static uint64_t now();
 
 private:
-    std::atomic<time_t> last_tick_;
-    zactor_t*           thread_;
+    void run();
+    /// terminate the process, the stage didn't beat (called with the lock of the thread)
+    void expired(Heartbeat stage, uint64_t lag, std::unique_lock<std::mutex>& lock);
+    /// interval of checks for the limits [ms]
+    int64_t interval() const;
+
+    std::array<std::atomic<uint64_t>, HEARTBEAT_COUNT> _beats;
+    std::array<std::atomic<uint32_t>, HEARTBEAT_COUNT> _limits;
+
+    std::thread             _thread;
+    std::mutex              _mutex;
+    std::condition_variable _wakeup;
+    bool                    _stopped = false;
 };
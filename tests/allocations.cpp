@@ -0,0 +1,118 @@
+#include <catch2/catch.hpp>
+#include "helpers.h"
+#include "src/clock.h"
+#include "src/tpowerconfiguration.h"
+#include <atomic>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <string>
+#include <vector>
+
+// Global allocator hook: counts allocations while enabled
+// (not inlined, so the compiler doesn't pair malloc/free with new/delete of callers)
+static std::atomic<bool>   s_counting{false};
+static std::atomic<size_t> s_allocations{0};
+
+[[gnu::noinline]] void* operator new(size_t size)
+{
+    if (s_counting) {
+        s_allocations++;
+    }
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+/// allocations done by f
+template <class F>
+static size_t s_countAllocations(F f)
+{
+    s_allocations = 0;
+    s_counting    = true;
+    f();
+    s_counting = false;
+    return s_allocations;
+}
+
+TEST_CASE("steady state metric processing does not allocate")
+{
+    size_t sent = 0;
+
+    TotalPowerConfiguration config([&sent](const MetricInfo&) {
+        sent++;
+        return true;
+    });
+
+    bool lazy = GENERATE(false, true);
+    INFO("lazy calculation: " << lazy);
+
+    // publishing is throttled within a second, batches run a second apart
+    VirtualTime time(1600000000);
+
+    TPowerSettings settings;
+    settings.lazyCalculation    = lazy;
+    settings.statisticWindows   = {60, 900};
+    settings.publishEnergy      = true;
+    settings.publishOldestInput = true;
+    config.settings(settings);
+
+    // 2 DCs with 2 racks by 4 devices
+    PowerTopology racks, dcs;
+    for (int i = 0; i < 16; ++i) {
+        std::string device = "epdu-" + std::to_string(i);
+        racks["rack-" + std::to_string(i / 4)].push_back(device);
+        dcs["datacenter-" + std::to_string(i / 8)].push_back(device);
+    }
+    config.loadTopology(racks, dcs);
+
+    // samples as they are read from shm (strings are owned by the shm message)
+    std::vector<std::string> devices;
+    for (int i = 0; i < 16; ++i) {
+        devices.push_back("epdu-" + std::to_string(i));
+    }
+    devices.push_back("sensor-1"); // not in the topology
+
+    auto batch = [&](double value) {
+        Clock::advance(1);
+        uint64_t now = Clock::now();
+        for (const auto& device : devices) {
+            for (auto quantity : quantity::names) {
+                config.processMetric(MetricSample(device, quantity, "W", value, now, 300));
+            }
+        }
+        config.publishPending();
+    };
+
+    // first batch creates published metrics and pending lists
+    batch(100);
+    CHECK(sent > 0);
+
+    // changed totals are published with their statistics
+    for (double value : {200, 300}) {
+        size_t before = sent;
+        CHECK(s_countAllocations([&] {
+            batch(value);
+        }) == 0);
+        CHECK(sent > before);
+    }
+    // unchanged totals are not
+    batch(300);
+    size_t before = sent;
+    CHECK(s_countAllocations([&] {
+        batch(300);
+    }) == 0);
+    CHECK(sent == before);
+}
@@ -0,0 +1,183 @@
+#include <catch2/catch.hpp>
+#include "helpers.h"
+#include "src/calc_power.h"
+#include "src/metriclist.h"
+#include "src/stagestats.h"
+#include "src/tp_unit.h"
+#include "src/tpowerconfiguration.h"
+#include <fty_common_asset_types.h>
+#include <ctime>
+#include <string>
+#include <vector>
+
+// Benchmarks are hidden, run them with "[benchmark]" and compare with a baseline:
+//   fty-metric-tpower-test "[benchmark]" --baseline benchmarks.txt --tolerance 10
+
+static const char* s_dcQuantities[] = {"realpower.default", "realpower.input.L1", "realpower.input.L2",
+    "realpower.input.L3", "realpower.output.L1", "realpower.output.L2", "realpower.output.L3"};
+
+/// unit of the kind with devices reporting all DC quantities
+static void s_fill(TPUnit& unit, const char* name, TPUnitKind kind, int devices)
+{
+    unit.name(name);
+    unit.kind(kind);
+    for (int i = 0; i < devices; ++i) {
+        std::string device = std::string(name) + "-device-" + std::to_string(i);
+        unit.addPowerDevice(device);
+        for (const char* quantity : s_dcQuantities) {
+            unit.setMeasurement(s_metric(device, quantity, 100 + i));
+        }
+    }
+}
+
+TEST_CASE("metric list benchmark", "[.][benchmark]")
+{
+    MetricList list;
+    MetricInfo M = s_metric("epdu-1", "realpower.input.L2", 42);
+    for (const char* quantity : s_dcQuantities) {
+        list.addMetricInfo(s_metric("epdu-1", quantity, 100));
+    }
+
+    BENCHMARK("MetricList::addMetricInfo")
+    {
+        list.addMetricInfo(M);
+    };
+    BENCHMARK("MetricList::find")
+    {
+        return list.find(Quantity::REALPOWER_INPUT_L2);
+    };
+    BENCHMARK("MetricList::removeOldMetrics")
+    {
+        return list.removeOldMetrics();
+    };
+}
+
+TEST_CASE("tp unit benchmark", "[.][benchmark]")
+{
+    const std::vector<Quantity> rackQuantities = {Quantity::REALPOWER_DEFAULT};
+    const std::vector<Quantity> dcQuantities   = {Quantity::REALPOWER_DEFAULT, Quantity::REALPOWER_INPUT_L1,
+        Quantity::REALPOWER_INPUT_L2, Quantity::REALPOWER_INPUT_L3, Quantity::REALPOWER_OUTPUT_L1,
+        Quantity::REALPOWER_OUTPUT_L2, Quantity::REALPOWER_OUTPUT_L3, Quantity::POWER_INPUT_L1,
+        Quantity::POWER_INPUT_L2, Quantity::POWER_INPUT_L3, Quantity::POWER_INPUT_IMBALANCE};
+
+    TPUnit rack, dc, row;
+    s_fill(rack, "rack-1", TPUnitKind::RACK, 10);
+    s_fill(dc, "datacenter-1", TPUnitKind::DC, 100);
+
+    // row summed from 10 racks of 10 devices
+    std::vector<TPUnit> racks(10);
+    row.name("row-1");
+    row.kind(TPUnitKind::ROW);
+    for (size_t i = 0; i < racks.size(); ++i) {
+        s_fill(racks[i], ("rack-" + std::to_string(i)).c_str(), TPUnitKind::RACK, 10);
+        racks[i].calculate(rackQuantities);
+        row.addChild(&racks[i]);
+    }
+    row.rollup(quantity::mask(Quantity::REALPOWER_DEFAULT));
+
+    BENCHMARK("TPUnit::calculate rack (10 devices)")
+    {
+        rack.calculate(rackQuantities);
+    };
+    BENCHMARK("TPUnit::calculate DC (100 devices)")
+    {
+        dc.calculate(dcQuantities);
+    };
+    BENCHMARK("TPUnit::calculate DC quantity (100 devices)")
+    {
+        dc.calculate(Quantity::REALPOWER_OUTPUT_L2);
+    };
+    BENCHMARK("TPUnit::calculate roll-up (10 children)")
+    {
+        row.calculate(rackQuantities);
+    };
+    BENCHMARK("TPUnit::statistics")
+    {
+        return rack.statistics(uint64_t(::time(nullptr))).size();
+    };
+    BENCHMARK("TPUnit::dropOldMetricInfos (100 devices)")
+    {
+        dc.dropOldMetricInfos();
+    };
+}
+
+TEST_CASE("tpower configuration benchmark", "[.][benchmark]")
+{
+    TotalPowerConfiguration config([](const MetricInfo&) {
+        return true;
+    });
+
+    // 1000 racks by 10 devices, 10 DCs
+    PowerTopology racks, dcs;
+    for (int i = 0; i < 10000; ++i) {
+        std::string device = "epdu-" + std::to_string(i);
+        racks["rack-" + std::to_string(i / 10)].push_back(device);
+        dcs["datacenter-" + std::to_string(i / 1000)].push_back(device);
+    }
+    config.loadTopology(racks, dcs);
+    for (int i = 0; i < 10000; ++i) {
+        config.processMetric(s_metric("epdu-" + std::to_string(i), "realpower.default", 100));
+    }
+
+    BENCHMARK("TotalPowerConfiguration::getPollInterval (1010 units)")
+    {
+        return config.getPollInterval();
+    };
+}
+
+TEST_CASE("stage stats benchmark", "[.][benchmark]")
+{
+    LatencyHistogram histogram;
+    uint64_t         value = 1;
+
+    BENCHMARK("LatencyHistogram::record")
+    {
+        histogram.record(value++ & 0xffff);
+    };
+    BENCHMARK("StageTimer (sampled stage)")
+    {
+        StageTimer timer(Stage::PARSE);
+    };
+    BENCHMARK("StageTimer (every call)")
+    {
+        StageTimer timer(Stage::WRITE_METRIC);
+    };
+}
+
+/// container of feeds, each powering pdus powering epdus (pdus are not measured)
+static void s_linkGraph(int feeds, int pdus, int epdus, std::map<uint32_t, device_info_t>& devices,
+    std::set<std::pair<uint32_t, uint32_t>>& links, std::set<device_info_t>& border)
+{
+    uint32_t id  = 1;
+    auto     add = [&devices, &id](const char* prefix, int subtype) {
+        devices.emplace(id, std::make_tuple(id, prefix + std::to_string(id), std::string(prefix), uint32_t(subtype)));
+        return id++;
+    };
+    for (int feed = 0; feed < feeds; ++feed) {
+        uint32_t feedId = add("pdu-", persist::PDU);
+        border.insert(devices[feedId]);
+        for (int pdu = 0; pdu < pdus; ++pdu) {
+            uint32_t pduId = add("pdu-", persist::PDU);
+            links.emplace(feedId, pduId);
+            for (int epdu = 0; epdu < epdus; ++epdu) {
+                links.emplace(pduId, add("epdu-", persist::EPDU));
+            }
+        }
+    }
+}
+
+TEST_CASE("calc power benchmark", "[.][benchmark]")
+{
+    for (int epdus : {1, 10, 100}) {
+        std::map<uint32_t, device_info_t>       devices;
+        std::set<std::pair<uint32_t, uint32_t>> links;
+        std::set<device_info_t>                 border;
+        s_linkGraph(2, 5, epdus, devices, links, border);
+        REQUIRE(compute_total_power_v2(devices, links, border).size() == size_t(10 * epdus));
+
+        BENCHMARK("compute_total_power_v2 (" + std::to_string(devices.size()) + " devices)")
+        {
+            return compute_total_power_v2(devices, links, border);
+        };
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "src/clock.h"
+#include "src/metricinfo.h"
+#include "src/tpowerconfiguration.h"
+#include <ctime>
+#include <string>
+#include <vector>
+
+/// virtual time for the scope
+struct VirtualTime
+{
+    VirtualTime(uint64_t start)
+    {
+        Clock::setVirtual(start);
+    };
+    ~VirtualTime()
+    {
+        Clock::setSystem();
+    };
+};
+
+/// metric of a device measured now
+static inline MetricInfo s_metric(const std::string& device, const std::string& quantity, double value)
+{
+    return MetricInfo(device, quantity, "W", value, uint64_t(::time(nullptr)), 300);
+}
+
+/// configuration keeping the published totals and the sent alerts
+struct ConfigurationFixture
+{
+    std::vector<MetricInfo>     sent;
+    std::vector<ThresholdAlert> alerts;
+    TotalPowerConfiguration     config;
+
+    ConfigurationFixture()
+        : config([this](const MetricInfo& M) {
+            sent.push_back(M);
+            return true;
+        })
+    {
+        config.alertFunction([this](const ThresholdAlert& alert) {
+            alerts.push_back(alert);
+            return true;
+        });
+    }
+    ConfigurationFixture(const ConfigurationFixture&) = delete;
+    ConfigurationFixture& operator=(const ConfigurationFixture&) = delete;
+
+    /// apply the settings and load the topology
+    void load(const TPowerSettings& settings, const PowerTopology& racks, const PowerTopology& dcs = {})
+    {
+        config.settings(settings);
+        config.loadTopology(racks, dcs);
+    }
+
+    /// values of the quantity published for the unit
+    std::vector<double> published(const std::string& unit, const std::string& quantity = "realpower.default") const
+    {
+        std::vector<double> result;
+        for (const auto& M : sent) {
+            if ((M.getElementName() == unit) && (M.getSource() == quantity)) {
+                result.push_back(M.getValue());
+            }
+        }
+        return result;
+    }
+};
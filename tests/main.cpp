@@ -13,5 +13,116 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
     ========================================================================
 */
-#define CATCH_CONFIG_MAIN // This tells Catch to provide a main() - only do this in one cpp file
+#define CATCH_CONFIG_RUNNER // main() is below, it compares benchmarks with the baseline
 #include <catch2/catch.hpp>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace {
+
+/// mean time of benchmarks run [ns] by name
+std::map<std::string, double> s_means;
+
+/// collects results of benchmarks
+class BaselineListener : public Catch::TestEventListenerBase
+{
+public:
+    using TestEventListenerBase::TestEventListenerBase;
+
+    void benchmarkEnded(Catch::BenchmarkStats<> const& stats) override
+    {
+        s_means[stats.info.name] = stats.mean.point.count();
+    }
+};
+
+/// baseline file: "<mean [ns]> <name>" per line
+std::map<std::string, double> s_loadBaseline(const std::string& path)
+{
+    std::map<std::string, double> result;
+    std::ifstream                 file(path);
+    std::string                   line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        double             mean = 0;
+        std::string        name;
+        if ((stream >> mean) && std::getline(stream >> std::ws, name)) {
+            result[name] = mean;
+        }
+    }
+    return result;
+}
+
+bool s_saveBaseline(const std::string& path, const std::map<std::string, double>& means)
+{
+    std::ofstream file(path);
+    for (const auto& it : means) {
+        file << it.second << " " << it.first << "\n";
+    }
+    return bool(file);
+}
+
+/// @return number of benchmarks slower than the baseline by more than tolerance [%]
+int s_compare(const std::map<std::string, double>& baseline, double tolerance)
+{
+    int regressions = 0;
+    for (const auto& it : s_means) {
+        auto base = baseline.find(it.first);
+        if ((base == baseline.end()) || (base->second <= 0)) {
+            Catch::cout() << "baseline: '" << it.first << "' is new\n";
+            continue;
+        }
+        double change = (it.second - base->second) / base->second * 100;
+        bool   failed = change > tolerance;
+        Catch::cout() << "baseline: '" << it.first << "' " << base->second << " ns -> " << it.second << " ns ("
+                      << (change >= 0 ? "+" : "") << change << " %)" << (failed ? " REGRESSION" : "") << "\n";
+        regressions += failed ? 1 : 0;
+    }
+    return regressions;
+}
+
+} // namespace
+
+CATCH_REGISTER_LISTENER(BaselineListener)
+
+int main(int argc, char* argv[])
+{
+    Catch::Session session;
+
+    std::string baseline;
+    double      tolerance = 10;
+    bool        update    = false;
+
+    using namespace Catch::clara;
+    auto cli = session.cli() |
+               Opt(baseline, "file")["--baseline"](
+                   "compare benchmarks with the baseline file, the file is written if it doesn't exist") |
+               Opt(tolerance, "percent")["--tolerance"]("slowdown reported as regression (default 10 %)") |
+               Opt(update)["--update-baseline"]("write the results to the baseline file");
+    session.cli(cli);
+
+    int result = session.applyCommandLine(argc, argv);
+    if (result != 0) {
+        return result;
+    }
+    result = session.run();
+
+    if (baseline.empty() || s_means.empty()) {
+        return result;
+    }
+    auto stored = s_loadBaseline(baseline);
+    if (update || stored.empty()) {
+        if (!s_saveBaseline(baseline, s_means)) {
+            Catch::cerr() << "baseline: can't write " << baseline << "\n";
+            return result + 1;
+        }
+        Catch::cout() << "baseline: " << s_means.size() << " results written to " << baseline << "\n";
+        return result;
+    }
+    int regressions = s_compare(stored, tolerance);
+    if (regressions > 0) {
+        Catch::cout() << "baseline: " << regressions << " regression(s) above " << tolerance << " %\n";
+    }
+    return result + regressions;
+}
@@ -0,0 +1,58 @@
+#include <catch2/catch.hpp>
+#include "src/measurement.h"
+#include "src/metriclist.h"
+#include <ctime>
+#include <string>
+
+TEST_CASE("name registry")
+{
+    NameRegistry registry;
+    CHECK(registry.intern("") == NameRegistry::NONE);
+    CHECK(registry.find("epdu-1") == NameRegistry::NONE);
+
+    uint32_t id = registry.intern("epdu-1");
+    CHECK(id != NameRegistry::NONE);
+    CHECK(registry.intern("epdu-1") == id);
+    CHECK(registry.find("epdu-1") == id);
+    CHECK(registry.name(id) == "epdu-1");
+
+    // IDs and names survive rehashing
+    for (int i = 0; i < 1000; ++i) {
+        registry.intern("device-" + std::to_string(i));
+    }
+    CHECK(registry.size() == 1002);
+    CHECK(registry.find("epdu-1") == id);
+    CHECK(registry.name(registry.find("device-999")) == "device-999");
+    CHECK(registry.name(123456) == "");
+}
+
+TEST_CASE("measurement record")
+{
+    uint64_t   now = uint64_t(::time(nullptr));
+    MetricInfo M("epdu-1", "realpower.input.L2", "W", 42.5, now, 300);
+
+    auto measurement = Measurement::fromMetricInfo(Quantity::REALPOWER_INPUT_L2, M);
+    CHECK(!measurement.isUnknown());
+    CHECK(!measurement.expired(now + 300));
+    CHECK(measurement.expired(now + 301));
+
+    auto back = measurement.toMetricInfo();
+    CHECK(back.getElementName() == "epdu-1");
+    CHECK(back.getSource() == "realpower.input.L2");
+    CHECK(back.getUnits() == "W");
+    CHECK(back.getValue() == 42.5);
+    CHECK(back.getTimestamp() == now);
+    CHECK(back.getTtl() == 300);
+
+    MetricList list;
+    list.addMetricInfo(M);
+    list.addMetricInfo(MetricInfo("epdu-1", "voltage.input.L1", "V", 230, now, 300));
+    CHECK(list.find(Quantity::REALPOWER_INPUT_L2) == 42.5);
+    CHECK(std::isnan(list.find(Quantity::REALPOWER_DEFAULT)));
+    CHECK(list.getMetricInfo(Quantity::REALPOWER_DEFAULT).isUnknown());
+
+    list.addMetricInfo(MetricInfo("epdu-1", "realpower.default", "W", 1, now - 400, 300));
+    CHECK(list.removeOldMetrics() == 1);
+    CHECK(std::isnan(list.find(Quantity::REALPOWER_DEFAULT)));
+    CHECK(list.find(Quantity::REALPOWER_INPUT_L2) == 42.5);
+}
@@ -2,6 +2,7 @@
 #include <malamute.h>
 #include "src/metricinfo.h"
 #include "src/fty_metric_tpower_server.h"
+#include "helpers.h"
 #include <fty_proto.h>
 #include <fty_shm.h>
 
@@ -30,3 +31,23 @@ TEST_CASE("fty metric tpower server test")
     fty_shm_delete_test_dir();
     printf("OK\n");
 }
+
+TEST_CASE("fty metric tpower server pulls apparent power from shm")
+{
+    REQUIRE(fty_shm_set_test_dir("selftest-rw") == 0);
+
+    // measured apparent power of the device, not V x I
+    REQUIRE(fty::shm::write_metric("ups-1", "power.input.L1", "1000", "VA", 500) == 0);
+    REQUIRE(fty::shm::write_metric("ups-1", "voltage.input.L1-N", "230", "V", 500) == 0);
+    REQUIRE(fty::shm::write_metric("ups-1", "current.input.L1", "2", "A", 500) == 0);
+
+    ConfigurationFixture fixture;
+    fixture.config.loadTopology({}, {{"datacenter-1", {"ups-1"}}});
+    pull_metrics(fixture.config);
+
+    auto published = fixture.published("datacenter-1", "power.input.L1");
+    REQUIRE(published.size() == 1);
+    CHECK(published[0] == Approx(1000));
+
+    fty_shm_delete_test_dir();
+}
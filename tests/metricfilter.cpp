@@ -0,0 +1,33 @@
+#include <catch2/catch.hpp>
+#include "src/metricfilter.h"
+#include <string>
+
+TEST_CASE("metric filter")
+{
+    MetricFilter filter;
+    filter.add("epdu-1", Quantity::REALPOWER_DEFAULT);
+    filter.add("ups-1", Quantity::REALPOWER_DEFAULT);
+    filter.add("ups-1", Quantity::REALPOWER_OUTPUT_L1);
+
+    CHECK(filter.size() == 2);
+    CHECK(filter.contains("epdu-1", "realpower.default"));
+    CHECK(!filter.contains("epdu-1", "realpower.output.L1"));
+    CHECK(filter.contains("ups-1", Quantity::REALPOWER_OUTPUT_L1));
+    CHECK(!filter.contains("ups-1", "realpower.output.L2"));
+    CHECK(!filter.contains("ups-1", "temperature"));
+    CHECK(!filter.contains("sensor-1", "realpower.default"));
+    CHECK(!filter.contains("", "realpower.default"));
+
+    // entries survive rehashing
+    for (int i = 0; i < 1000; ++i) {
+        filter.add("device-" + std::to_string(i), Quantity::REALPOWER_INPUT_L1);
+    }
+    CHECK(filter.size() == 1002);
+    CHECK(filter.contains("epdu-1", "realpower.default"));
+    CHECK(filter.contains("device-999", "realpower.input.L1"));
+    CHECK(!filter.contains("device-1000", "realpower.input.L1"));
+
+    filter.clear();
+    CHECK(filter.size() == 0);
+    CHECK(!filter.contains("epdu-1", "realpower.default"));
+}
@@ -0,0 +1,162 @@
+#include <catch2/catch.hpp>
+#include "src/clock.h"
+#include "src/metricrecord.h"
+#include "src/tpowerconfiguration.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+
+TEST_CASE("metric record")
+{
+    const std::string path = "metricrecord-test.rec";
+
+    MetricRecorder recorder;
+    REQUIRE(recorder.open(path));
+    recorder.beginBatch(1000);
+    recorder.add(MetricSample("epdu-1", "realpower.default", "W", 100.5, 1000, 300));
+    recorder.add(MetricSample("epdu-2", "realpower.default", "W", std::nan(""), 990, 300));
+    recorder.add(MetricSample("epdu-1", "realpower.default", "W", -1, 1005, 0));
+    CHECK(recorder.endBatch());
+    recorder.beginBatch(1010); // empty batch is not written
+    CHECK(recorder.endBatch());
+    recorder.beginBatch(1020);
+    recorder.add(MetricSample("ups-1", "voltage.input.L1-N", "V", 230, 1020, 600));
+    recorder.add(MetricSample("epdu-2", "realpower.default", "W", 42, 1020, 300));
+    CHECK(recorder.endBatch());
+    CHECK(recorder.batches() == 2);
+    recorder.close();
+
+    MetricReplay  replay;
+    RecordedBatch batch;
+    REQUIRE(replay.open(path));
+    REQUIRE(replay.next(batch));
+    CHECK(batch.timestamp == 1000);
+    REQUIRE(batch.metrics.size() == 3);
+    CHECK(batch.metrics[0].element == "epdu-1");
+    CHECK(batch.metrics[0].quantity == "realpower.default");
+    CHECK(batch.metrics[0].units == "W");
+    CHECK(batch.metrics[0].value == 100.5);
+    CHECK(batch.metrics[0].ttl == 300);
+    CHECK(batch.metrics[1].element == "epdu-2");
+    CHECK(std::isnan(batch.metrics[1].value));
+    CHECK(batch.metrics[1].timestamp == 990);
+    CHECK(batch.metrics[2].value == -1);
+    CHECK(batch.metrics[2].timestamp == 1005);
+    CHECK(batch.metrics[2].ttl == 0);
+
+    REQUIRE(replay.next(batch));
+    CHECK(batch.timestamp == 1020);
+    REQUIRE(batch.metrics.size() == 2);
+    CHECK(batch.metrics[0].element == "ups-1");
+    CHECK(batch.metrics[0].units == "V");
+    CHECK(batch.metrics[1].element == "epdu-2"); // string of the previous batch
+    CHECK(batch.metrics[1].sample().value == 42);
+    CHECK(!replay.next(batch));
+    CHECK(replay.error().empty());
+    replay.close();
+
+    // truncated record
+    std::string content;
+    {
+        std::ifstream file(path, std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(content.data(), std::streamsize(content.size() - 3));
+    }
+    REQUIRE(replay.open(path));
+    CHECK(replay.next(batch));
+    CHECK(!replay.next(batch));
+    CHECK(!replay.error().empty());
+    replay.close();
+
+    std::remove(path.c_str());
+    CHECK(!replay.open(path));
+}
+
+TEST_CASE("metric record replay")
+{
+    const std::string path = "metricrecord-replay.rec";
+
+    struct Run
+    {
+        std::map<std::string, double> totals;
+        TotalPowerConfiguration       config;
+
+        Run()
+            : config([this](const MetricInfo& M) {
+                totals[M.getElementName() + "/" + M.getSource()] = M.getValue();
+                return true;
+            })
+        {
+        }
+    };
+
+    PowerTopology    racks = {{"rack-1", {"epdu-1", "epdu-2"}}}, dcs = {{"datacenter-1", {"ups-1"}}};
+    LocationTopology locations;
+    locations.rows     = {{"row-1", {"epdu-1", "epdu-2"}}};
+    locations.children = {{"row-1", {"rack-1"}}};
+    locations.groups   = {{"zone-1", {"rack-1", "ups-1"}}, {"empty", {}}};
+
+    // record the agent
+    Run            recorded;
+    TPowerSettings settings;
+    settings.recordFile = path;
+    recorded.config.settings(settings);
+    REQUIRE(recorded.config.recording());
+    recorded.config.loadTopology(racks, dcs, locations);
+
+    uint64_t now = Clock::now();
+    recorded.config.beginBatch();
+    for (const auto& metric : {MetricSample("epdu-1", "realpower.default", "W", 100, now, 300),
+             MetricSample("epdu-2", "realpower.default", "W", 50, now, 300),
+             MetricSample("ups-1", "realpower.default", "W", 1000, now, 300),
+             MetricSample("sensor-1", "temperature", "C", 20, now, 300)}) {
+        recorded.config.record(metric);
+        if (recorded.config.interesting(metric.element, metric.quantity)) {
+            recorded.config.processMetric(metric);
+        }
+    }
+    recorded.config.endBatch();
+    settings.recordFile.clear();
+    recorded.config.settings(settings); // the record is closed
+    CHECK(!recorded.config.recording());
+
+    // snapshot is the loaded topology
+    PowerTopology    racks2, dcs2;
+    LocationTopology locations2;
+    REQUIRE(loadTopologySnapshot(path + ".topology", racks2, dcs2, locations2));
+    CHECK(racks2 == racks);
+    CHECK(dcs2 == dcs);
+    CHECK(locations2.rows == locations.rows);
+    CHECK(locations2.rooms.empty());
+    CHECK(locations2.children == locations.children);
+    CHECK(locations2.groups == locations.groups);
+
+    // replay gives the same totals
+    Run replayed;
+    replayed.config.loadTopology(racks2, dcs2, locations2);
+    MetricReplay  replay;
+    RecordedBatch batch;
+    REQUIRE(replay.open(path));
+    REQUIRE(replay.next(batch));
+    CHECK(batch.metrics.size() == 4); // not interesting metrics are recorded too
+    replayed.config.beginBatch();
+    for (const auto& metric : batch.metrics) {
+        if (replayed.config.interesting(metric.element, metric.quantity)) {
+            replayed.config.processMetric(metric.sample());
+        }
+    }
+    replayed.config.endBatch();
+    CHECK(!replay.next(batch));
+
+    CHECK(recorded.totals["rack-1/realpower.default"] == 150);
+    CHECK(recorded.totals["zone-1/realpower.default"] == 1150);
+    CHECK(replayed.totals == recorded.totals);
+
+    std::remove(path.c_str());
+    std::remove((path + ".topology").c_str());
+}
@@ -0,0 +1,83 @@
+#include <catch2/catch.hpp>
+#include "src/reactor.h"
+#include <unistd.h>
+#include <vector>
+
+TEST_CASE("reactor timers")
+{
+    Reactor reactor;
+    REQUIRE(reactor.valid());
+
+    std::vector<int> fired;
+    int              first = reactor.addTimer([&]() {
+        fired.push_back(1);
+    });
+    int              second = reactor.addTimer([&]() {
+        fired.push_back(2);
+        reactor.stop();
+    });
+    int              disarmed = reactor.addTimer([&]() {
+        fired.push_back(3);
+    });
+    REQUIRE(first >= 0);
+    REQUIRE(second >= 0);
+    REQUIRE(disarmed >= 0);
+
+    uint64_t start = Reactor::now();
+    reactor.armIn(second, 40);
+    reactor.armIn(first, 10);
+    reactor.armIn(disarmed, 20);
+    reactor.armAt(disarmed, 0);
+    CHECK(reactor.deadline(disarmed) == 0);
+    reactor.run();
+
+    CHECK(fired == std::vector<int>{1, 2});
+    CHECK(Reactor::now() - start >= 40);
+    // nothing happens between the timers
+    CHECK(reactor.wakeups() == 2);
+    CHECK(reactor.deadline(first) == 0);
+}
+
+TEST_CASE("reactor sources")
+{
+    Reactor reactor;
+    int     fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    // reader reads one byte per call, level triggered
+    std::vector<char> read;
+    REQUIRE(reactor.addReader(fds[0], [&]() {
+        char c;
+        if (::read(fds[0], &c, 1) == 1) {
+            read.push_back(c);
+        }
+    }));
+
+    // socket source: handled while messages are pending, without any event of its descriptor
+    int  events[2];
+    int  pending = 3, handled = 0;
+    REQUIRE(pipe(events) == 0);
+    REQUIRE(reactor.addSocket(
+        events[0],
+        [&]() {
+            return pending > 0;
+        },
+        [&]() {
+            pending--;
+            handled++;
+        }));
+
+    int timer = reactor.addTimer([&]() {
+        reactor.stop();
+    });
+    REQUIRE(write(fds[1], "ab", 2) == 2);
+    reactor.armIn(timer, 20);
+    reactor.run();
+
+    CHECK(handled == 3);
+    CHECK(read == std::vector<char>{'a', 'b'});
+
+    for (int fd : {fds[0], fds[1], events[0], events[1]}) {
+        close(fd);
+    }
+}
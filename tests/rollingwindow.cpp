@@ -0,0 +1,72 @@
+#include <catch2/catch.hpp>
+#include "src/rollingwindow.h"
+#include "src/tp_unit.h"
+
+TEST_CASE("rolling window")
+{
+    RollingWindow window(900);
+    CHECK(window.name() == "15m");
+    CHECK(RollingWindow(90).name() == "90s");
+    CHECK(RollingWindow(7200).name() == "2h");
+
+    // the window is split into whole seconds, its name says what it covers
+    CHECK(RollingWindow(100).seconds() == 105);
+    CHECK(RollingWindow(100).name() == "105s");
+    CHECK(RollingWindow(20).seconds() == 15);
+    CHECK(RollingWindow(1).seconds() == 15);
+
+    uint64_t t = 1600000000;
+    CHECK(window.stats(t).count == 0);
+    CHECK(std::isnan(window.stats(t).average));
+
+    window.add(t, 100);
+    window.add(t + 10, 300);
+    window.add(t + 120, 200);
+    window.add(t + 130, std::nan("")); // ignored
+
+    auto stats = window.stats(t + 130);
+    CHECK(stats.count == 3);
+    CHECK(stats.average == Approx(200));
+    CHECK(stats.minimum == Approx(100));
+    CHECK(stats.maximum == Approx(300));
+
+    // the first slice left the window, the last one is still there
+    stats = window.stats(t + 900);
+    CHECK(stats.count == 1);
+    CHECK(stats.average == Approx(200));
+
+    // slices are reused when the ring goes round
+    window.add(t + 2000, 50);
+    stats = window.stats(t + 2000);
+    CHECK(stats.count == 1);
+    CHECK(stats.maximum == Approx(50));
+}
+
+TEST_CASE("tp unit statistics")
+{
+    TPowerSettings settings;
+    settings.statisticWindows = {60, 900};
+
+    TPUnit unit;
+    unit.name("rack-1");
+    unit.settings(&settings);
+    unit.addPowerDevice("epdu-1");
+
+    uint64_t now = uint64_t(::time(nullptr));
+    unit.setMeasurement(MetricInfo("epdu-1", "realpower.default", "W", 100, now, 300));
+    unit.calculate(Quantity::REALPOWER_DEFAULT);
+    unit.setMeasurement(MetricInfo("epdu-1", "realpower.default", "W", 200, now, 300));
+    unit.calculate(Quantity::REALPOWER_DEFAULT);
+
+    CHECK(unit.statistics(1, now).average == Approx(150));
+
+    const auto& metrics = unit.statistics(now);
+    REQUIRE(metrics.size() == 6);
+    CHECK(metrics[0].getSource() == "realpower.default.avg_1m");
+    CHECK(metrics[0].getElementName() == "rack-1");
+    CHECK(metrics[0].getValue() == Approx(150));
+    CHECK(metrics[4].getSource() == "realpower.default.min_15m");
+    CHECK(metrics[4].getValue() == Approx(100));
+    CHECK(metrics[5].getSource() == "realpower.default.max_15m");
+    CHECK(metrics[5].getValue() == Approx(200));
+}
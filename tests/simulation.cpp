@@ -0,0 +1,162 @@
+#include <catch2/catch.hpp>
+#include "helpers.h"
+#include "src/clock.h"
+#include "src/tpowerconfiguration.h"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct SimulationResult
+{
+    /// published totals by unit
+    std::map<std::string, uint64_t> published;
+    /// published totals of rack-3 while its device was offline
+    uint64_t publishedOffline = 0;
+    /// the first publishing of rack-10 (added by reconfiguration) [s since start]
+    uint64_t firstReconfigured = 0;
+    /// time from a changed device value to the publishing of the rack total [s] (rack-3 is not measured)
+    std::vector<uint64_t> latencies;
+    uint64_t              polls = 0;
+
+    bool operator==(const SimulationResult& other) const
+    {
+        return (published == other.published) && (publishedOffline == other.publishedOffline) &&
+               (firstReconfigured == other.firstReconfigured) && (latencies == other.latencies) &&
+               (polls == other.polls);
+    };
+};
+
+const uint64_t START  = 1600000000;
+const uint64_t HOUR   = 3600;
+const uint64_t REPORT = 60; ///< reporting period of devices [s]
+
+/// 24 hours of 10 racks (2 epdus each) and a DC (2 UPSes) driven like the agent main loop:
+/// - devices report realpower.default every minute, the value changes every 10 minutes
+/// - epdu-3-0 is offline from 4:00 to 6:00
+/// - rack-10 is added by reconfiguration at 12:00
+SimulationResult s_simulate(const TPowerSettings& settings)
+{
+    VirtualTime      time(START);
+    SimulationResult result;
+
+    std::map<std::string, uint64_t> pendingSince; // rack -> the oldest unpublished change
+    std::map<std::string, double>   values;       // device -> the last value
+
+    TotalPowerConfiguration config([&result, &pendingSince](const MetricInfo& M) {
+        if (M.getSource() != "realpower.default") {
+            return true;
+        }
+        const std::string& unit = M.getElementName();
+        uint64_t           now  = Clock::now() - START;
+        result.published[unit]++;
+        if ((unit == "rack-3") && (now >= 4 * HOUR + 600) && (now < 6 * HOUR)) {
+            // the last total is kept for its TTL after the device metric expired
+            result.publishedOffline++;
+        }
+        if ((unit == "rack-10") && (result.firstReconfigured == 0)) {
+            result.firstReconfigured = now;
+        }
+        auto pending = pendingSince.find(unit);
+        if ((pending != pendingSince.end()) && (pending->second != 0)) {
+            result.latencies.push_back(Clock::now() - pending->second);
+            pending->second = 0;
+        }
+        return true;
+    });
+    config.settings(settings);
+
+    PowerTopology racks, dcs;
+    auto          topology = [&racks, &dcs](int rackCount) {
+        racks.clear();
+        dcs.clear();
+        for (int rack = 0; rack < rackCount; ++rack) {
+            for (int device = 0; device < 2; ++device) {
+                racks["rack-" + std::to_string(rack)].push_back(
+                    "epdu-" + std::to_string(rack) + "-" + std::to_string(device));
+            }
+        }
+        dcs["datacenter-1"] = {"ups-1", "ups-2"};
+    };
+    topology(10);
+    config.loadTopology(racks, dcs);
+
+    uint64_t last = 0;
+    for (uint64_t t = 0; t < 24 * HOUR; ++t) {
+        Clock::set(START + t);
+
+        if (t == 12 * HOUR) {
+            topology(11);
+            config.loadTopology(racks, dcs);
+        }
+
+        // devices reporting in this second (spread over the period)
+        config.beginBatch();
+        int index = 0;
+        for (const auto* topo : {&racks, &dcs}) {
+            for (const auto& unit : *topo) {
+                for (const auto& device : unit.second) {
+                    ++index;
+                    if (((t + uint64_t(index)) % REPORT) != 0) {
+                        continue;
+                    }
+                    if ((device == "epdu-3-0") && (t >= 4 * HOUR) && (t < 6 * HOUR)) {
+                        continue;
+                    }
+                    double value = 100 + double(index % 7) * 10 + double((t / 600) % 5);
+                    if ((values[device] != value) && (topo == &racks) && (unit.first != "rack-3") &&
+                        (pendingSince[unit.first] == 0)) {
+                        pendingSince[unit.first] = Clock::now();
+                    }
+                    values[device] = value;
+                    config.processMetric(MetricSample(device, "realpower.default", "W", value, Clock::now(), 180));
+                }
+            }
+        }
+        config.endBatch();
+
+        // the main loop polls when the timeout elapsed
+        if ((t - last) * 1000 >= uint64_t(config.getTimeout())) {
+            last = t;
+            config.onPoll();
+            result.polls++;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+TEST_CASE("tpower 24h simulation")
+{
+    for (bool lazy : {false, true}) {
+        INFO("lazy calculation: " << lazy);
+        TPowerSettings settings;
+        settings.lazyCalculation    = lazy;
+        settings.minPublishInterval = lazy ? 10 : 0;
+
+        auto result = s_simulate(settings);
+        CHECK(result == s_simulate(settings)); // deterministic
+
+        // changed every 10 minutes, republished at least every 5 minutes
+        for (int rack = 0; rack < 10; ++rack) {
+            std::string name = "rack-" + std::to_string(rack);
+            INFO(name);
+            CHECK(result.published[name] >= ((rack == 3) ? 22 : 24) * HOUR / 300);
+        }
+        CHECK(result.published["datacenter-1"] >= 24 * HOUR / 300);
+        // unknown total is not published, rack-10 exists since the reconfiguration
+        CHECK(result.publishedOffline == 0);
+        CHECK(result.firstReconfigured >= 12 * HOUR);
+        CHECK(result.firstReconfigured < 12 * HOUR + REPORT);
+
+        REQUIRE(!result.latencies.empty());
+        std::sort(result.latencies.begin(), result.latencies.end());
+        uint64_t p99 = result.latencies[result.latencies.size() * 99 / 100];
+        // a change is published within the minimal interval, a second later at worst
+        CHECK(p99 <= settings.minPublishInterval);
+        CHECK(result.latencies.back() <= settings.minPublishInterval + 1);
+    }
+}
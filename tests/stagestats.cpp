@@ -0,0 +1,96 @@
+#include <catch2/catch.hpp>
+#include "src/stagestats.h"
+#include <map>
+#include <string>
+
+TEST_CASE("latency histogram")
+{
+    // buckets are exact within 1/16
+    for (uint64_t value : {0ull, 1ull, 15ull, 16ull, 17ull, 31ull, 32ull, 33ull, 1000ull, 123456789ull}) {
+        INFO(value);
+        size_t index = LatencyHistogram::bucket(value);
+        REQUIRE(index < LatencyHistogram::BUCKETS);
+        CHECK(LatencyHistogram::bucketMax(index) >= value);
+        CHECK(LatencyHistogram::bucketMax(index) - value <= value / 16);
+        if (index > 0) {
+            CHECK(LatencyHistogram::bucketMax(index - 1) < value);
+        }
+    }
+    CHECK(LatencyHistogram::bucket(uint64_t(-1)) == LatencyHistogram::BUCKETS - 1);
+
+    LatencyHistogram histogram;
+    CHECK(histogram.count() == 0);
+    CHECK(histogram.percentile(99) == 0);
+    CHECK(histogram.mean() == 0);
+
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        histogram.record(i * 1000); // 1 .. 1000 us
+    }
+    CHECK(histogram.count() == 1000);
+    CHECK(histogram.mean() == 500500);
+    CHECK(histogram.max() == 1000000);
+    CHECK(histogram.percentile(50) >= 500000);
+    CHECK(histogram.percentile(50) <= 500000 + 500000 / 16);
+    CHECK(histogram.percentile(99) >= 990000);
+    CHECK(histogram.percentile(99) <= 990000 + 990000 / 16);
+    CHECK(histogram.percentile(100) == 1000000); // not above the maximum
+
+    histogram.reset();
+    CHECK(histogram.count() == 0);
+    CHECK(histogram.max() == 0);
+}
+
+TEST_CASE("stage stats")
+{
+    StageStats::reset();
+    StageStats::enable(true);
+
+    // sampled stage is timed once per period
+    uint32_t period = StageStats::samplingPeriod(Stage::PARSE);
+    REQUIRE(period > 1);
+    for (uint32_t i = 0; i < 10 * period; ++i) {
+        StageTimer timer(Stage::PARSE);
+    }
+    CHECK(StageStats::histogram(Stage::PARSE).count() == 10);
+
+    REQUIRE(StageStats::samplingPeriod(Stage::CONFIGURE) == 1);
+    {
+        StageTimer timer(Stage::CONFIGURE);
+        timer.stop();
+        timer.stop(); // recorded once
+    }
+    CHECK(StageStats::histogram(Stage::CONFIGURE).count() == 1);
+
+    StageStats::enable(false);
+    {
+        StageTimer timer(Stage::CONFIGURE);
+    }
+    CHECK(StageStats::histogram(Stage::CONFIGURE).count() == 1);
+    StageStats::enable(true);
+
+    StageStats::count(Counter::DB_QUERIES, 3);
+    StageStats::count(Counter::DB_QUERIES);
+    CHECK(StageStats::counter(Counter::DB_QUERIES) == 4);
+
+    StageStats::record(Age::PUBLISH_LAG, 5);
+    StageStats::record(Age::PUBLISH_LAG, 300);
+    CHECK(StageStats::histogram(Age::PUBLISH_LAG).max() == 300);
+
+    std::map<std::string, std::string> report;
+    for (const auto& it : StageStats::report()) {
+        report.insert(it);
+    }
+    CHECK(report["configure.count"] == "1");
+    CHECK(report["parse.count"] == "10");
+    CHECK(report.count("shm_read.p99_us") == 1);
+    CHECK(report.count("write_metric.max_us") == 1);
+    CHECK(report["db_queries"] == "4");
+    CHECK(report["publish_lag.count"] == "2");
+    CHECK(report["publish_lag.p50_s"] == "5");
+    CHECK(report["input_age.count"] == "0");
+    CHECK(StageStats::dump().find("shm_read") != std::string::npos);
+
+    StageStats::reset();
+    CHECK(StageStats::counter(Counter::DB_QUERIES) == 0);
+    CHECK(StageStats::histogram(Age::PUBLISH_LAG).count() == 0);
+}
@@ -0,0 +1,318 @@
+#include <catch2/catch.hpp>
+#include "helpers.h"
+#include "src/clock.h"
+#include "src/tp_unit.h"
+#include <cmath>
+#include <ctime>
+#include <functional>
+
+TEST_CASE("tp unit deadband")
+{
+    TPowerSettings settings;
+    settings.deadband(Quantity::REALPOWER_DEFAULT).absolute = 10;
+
+    TPUnit rack;
+    rack.name("rack-1");
+    rack.settings(&settings);
+    rack.addPowerDevice("epdu-1");
+    rack.addPowerDevice("epdu-2");
+
+    rack.setMeasurement(s_metric("epdu-1", "realpower.default", 100));
+    rack.calculate(Quantity::REALPOWER_DEFAULT);
+    CHECK(rack.quantityIsUnknown(Quantity::REALPOWER_DEFAULT));
+
+    rack.setMeasurement(s_metric("epdu-2", "realpower.default", 200));
+    rack.calculate(Quantity::REALPOWER_DEFAULT);
+    REQUIRE(rack.changed(Quantity::REALPOWER_DEFAULT));
+    CHECK(rack.get(Quantity::REALPOWER_DEFAULT) == Approx(300));
+    rack.advertised(Quantity::REALPOWER_DEFAULT);
+    CHECK(!rack.changed(Quantity::REALPOWER_DEFAULT));
+
+    // inside of the deadband
+    rack.setMeasurement(s_metric("epdu-2", "realpower.default", 205));
+    rack.calculate(Quantity::REALPOWER_DEFAULT);
+    CHECK(!rack.changed(Quantity::REALPOWER_DEFAULT));
+    CHECK(rack.get(Quantity::REALPOWER_DEFAULT) == Approx(300));
+    CHECK(rack.deadbandSuppressed() == 1);
+
+    // out of the deadband
+    rack.setMeasurement(s_metric("epdu-2", "realpower.default", 215));
+    rack.calculate(Quantity::REALPOWER_DEFAULT);
+    CHECK(rack.changed(Quantity::REALPOWER_DEFAULT));
+    CHECK(rack.get(Quantity::REALPOWER_DEFAULT) == Approx(315));
+
+    // already advertised in this second
+    CHECK(!rack.advertise(Quantity::REALPOWER_DEFAULT));
+    CHECK(rack.throttled(Quantity::REALPOWER_DEFAULT));
+}
+
+TEST_CASE("tp unit relative deadband")
+{
+    Deadband deadband;
+    deadband.absolute = 0;
+    deadband.relative = 5;
+
+    CHECK(!deadband.exceeded(1000, 1040));
+    CHECK(deadband.exceeded(1000, 1060));
+    CHECK(deadband.exceeded(1000, 940));
+    CHECK(!deadband.exceeded(0, 0));
+}
+
+static void s_setPhases(TPUnit& unit, const char* device, int phases, double value)
+{
+    static const char* input[]  = {"realpower.input.L1", "realpower.input.L2", "realpower.input.L3"};
+    static const char* output[] = {"realpower.output.L1", "realpower.output.L2", "realpower.output.L3"};
+    for (int phase = 0; phase < phases; ++phase) {
+        unit.setMeasurement(s_metric(device, input[phase], value + phase));
+        unit.setMeasurement(s_metric(device, output[phase], value + phase));
+    }
+}
+
+TEST_CASE("tp unit fused calculation")
+{
+    const std::vector<Quantity> quantities = {Quantity::REALPOWER_DEFAULT, Quantity::REALPOWER_INPUT_L1,
+        Quantity::REALPOWER_INPUT_L2, Quantity::REALPOWER_INPUT_L3, Quantity::REALPOWER_OUTPUT_L1,
+        Quantity::REALPOWER_OUTPUT_L2, Quantity::REALPOWER_OUTPUT_L3};
+
+    // the same topology calculated together and quantity by quantity
+    auto check = [&quantities](const std::function<void(TPUnit&)>& fill) {
+        TPUnit fused, single;
+        for (TPUnit* unit : {&fused, &single}) {
+            unit->name("datacenter-1");
+            unit->kind(TPUnitKind::DC);
+            unit->addPowerDevice("ups-1");
+            unit->addPowerDevice("ups-2");
+            fill(*unit);
+        }
+        fused.calculate(quantities);
+        for (auto quantity : quantities) {
+            single.calculate(quantity);
+        }
+        for (auto quantity : quantities) {
+            INFO(quantity::name(quantity));
+            REQUIRE(fused.quantityIsKnown(quantity) == single.quantityIsKnown(quantity));
+            if (fused.quantityIsKnown(quantity)) {
+                CHECK(fused.get(quantity) == Approx(single.get(quantity)));
+            }
+        }
+    };
+
+    SECTION("three phases")
+    {
+        check([](TPUnit& unit) {
+            s_setPhases(unit, "ups-1", 3, 100);
+            s_setPhases(unit, "ups-2", 3, 200);
+        });
+    }
+    SECTION("default with phases fallback")
+    {
+        check([](TPUnit& unit) {
+            unit.setMeasurement(s_metric("ups-1", "realpower.default", 1000));
+            s_setPhases(unit, "ups-2", 3, 200);
+        });
+    }
+    SECTION("mixed phases")
+    {
+        check([](TPUnit& unit) {
+            s_setPhases(unit, "ups-1", 1, 100);
+            s_setPhases(unit, "ups-2", 3, 200);
+        });
+        check([](TPUnit& unit) {
+            s_setPhases(unit, "ups-1", 2, 100);
+            s_setPhases(unit, "ups-2", 1, 200);
+        });
+    }
+    SECTION("missing device")
+    {
+        check([](TPUnit& unit) {
+            s_setPhases(unit, "ups-1", 3, 100);
+        });
+    }
+}
+
+TEST_CASE("tp unit phases classification")
+{
+    TPUnit dc;
+    dc.name("datacenter-1");
+    dc.kind(TPUnitKind::DC);
+    dc.addPowerDevice("ups-1");
+    dc.addPowerDevice("ups-2");
+
+    s_setPhases(dc, "ups-1", 3, 100);
+    s_setPhases(dc, "ups-2", 1, 200);
+    dc.calculate(Quantity::REALPOWER_OUTPUT_L1);
+    CHECK(dc.quantityIsUnknown(Quantity::REALPOWER_OUTPUT_L1));
+
+    // the second device reports its other phases later
+    s_setPhases(dc, "ups-2", 3, 200);
+    dc.calculate(Quantity::REALPOWER_OUTPUT_L1);
+    REQUIRE(dc.quantityIsKnown(Quantity::REALPOWER_OUTPUT_L1));
+    CHECK(dc.get(Quantity::REALPOWER_OUTPUT_L1) == Approx(300));
+}
+
+TEST_CASE("tp unit apparent power and imbalance")
+{
+    TPUnit dc;
+    dc.name("datacenter-1");
+    dc.kind(TPUnitKind::DC);
+    dc.addPowerDevice("ups-1");
+    dc.addPowerDevice("ups-2");
+
+    const std::vector<Quantity> quantities = {Quantity::POWER_INPUT_L1, Quantity::POWER_INPUT_L2,
+        Quantity::POWER_INPUT_L3, Quantity::POWER_INPUT_IMBALANCE};
+
+    // ups-1 measures apparent power, ups-2 only voltage and current
+    dc.setMeasurement(MetricInfo("ups-1", "power.input.L1", "VA", 1000, uint64_t(::time(nullptr)), 300));
+    dc.setMeasurement(MetricInfo("ups-1", "power.input.L2", "VA", 1000, uint64_t(::time(nullptr)), 300));
+    dc.setMeasurement(MetricInfo("ups-1", "power.input.L3", "VA", 1000, uint64_t(::time(nullptr)), 300));
+    const char* phases[3]  = {"L1", "L2", "L3"};
+    double      current[3] = {10, 5, 0};
+    for (int phase = 0; phase < 3; ++phase) {
+        std::string voltage = std::string("voltage.input.") + phases[phase] + "-N";
+        dc.setMeasurement(MetricInfo("ups-2", voltage, "V", 200, uint64_t(::time(nullptr)), 300));
+    }
+    for (int phase = 0; phase < 2; ++phase) {
+        std::string name = std::string("current.input.") + phases[phase];
+        dc.setMeasurement(MetricInfo("ups-2", name, "A", current[phase], uint64_t(::time(nullptr)), 300));
+    }
+
+    // current of L3 is missing
+    dc.calculate(quantities);
+    CHECK(dc.get(Quantity::POWER_INPUT_L1) == Approx(3000));
+    CHECK(dc.get(Quantity::POWER_INPUT_L2) == Approx(2000));
+    CHECK(dc.quantityIsUnknown(Quantity::POWER_INPUT_L3));
+    CHECK(dc.quantityIsUnknown(Quantity::POWER_INPUT_IMBALANCE));
+
+    dc.setMeasurement(MetricInfo("ups-2", "current.input.L3", "A", current[2], uint64_t(::time(nullptr)), 300));
+    dc.calculate(quantities);
+    CHECK(dc.get(Quantity::POWER_INPUT_L3) == Approx(1000));
+    // average 2000 VA, L1 and L3 deviate by 1000 VA
+    CHECK(dc.get(Quantity::POWER_INPUT_IMBALANCE) == Approx(50));
+    CHECK(dc.getMetricInfo(Quantity::POWER_INPUT_IMBALANCE).getUnits() == "%");
+    CHECK(dc.getMetricInfo(Quantity::POWER_INPUT_L1).getUnits() == "VA");
+
+    // computed one by one too
+    dc.calculate(Quantity::POWER_INPUT_IMBALANCE);
+    CHECK(dc.get(Quantity::POWER_INPUT_IMBALANCE) == Approx(50));
+
+    // a rack computes them by the bigger kernel, still one calculation per call
+    TPUnit rack;
+    rack.name("rack-1");
+    rack.kind(TPUnitKind::RACK);
+    rack.addPowerDevice("ups-1");
+    rack.setMeasurement(MetricInfo("ups-1", "power.input.L1", "VA", 1000, uint64_t(::time(nullptr)), 300));
+    rack.calculate({Quantity::REALPOWER_DEFAULT, Quantity::POWER_INPUT_L1});
+    CHECK(rack.get(Quantity::POWER_INPUT_L1) == Approx(1000));
+    CHECK(rack.calculations() == 1);
+}
+
+TEST_CASE("quantity parsing")
+{
+    for (size_t q = 0; q < QUANTITY_COUNT; ++q) {
+        CHECK(quantity::fromString(quantity::names[q]) == Quantity(q));
+    }
+    CHECK(quantity::fromString("realpower.default@rack-1") == Quantity::UNKNOWN);
+    CHECK(quantity::fromString("realpower.input.L4") == Quantity::UNKNOWN);
+    CHECK(quantity::fromString("") == Quantity::UNKNOWN);
+    CHECK(quantity::mask(Quantity::UNKNOWN) == 0);
+}
+
+TEST_CASE("tp unit energy integration")
+{
+    TPUnit rack;
+    rack.name("rack-1");
+
+    uint64_t t     = uint64_t(::time(nullptr)) - 3600;
+    auto     total = [&rack](uint64_t timestamp, double value) {
+        rack.set(Quantity::REALPOWER_DEFAULT, Measurement(Quantity::REALPOWER_DEFAULT, 1, 1, value, timestamp, 360));
+    };
+
+    total(t, 1000);
+    CHECK(rack.energy() == 0);
+    total(t + 60, 2000); // 60s * 1500W
+    CHECK(rack.energy() == Approx(25));
+    total(t + 60, 3000); // the same second, replaces the last total
+    CHECK(rack.energy() == Approx(25));
+    total(t + 120, 3000);
+    CHECK(rack.energy() == Approx(75));
+
+    // gap longer than TTL of totals is not integrated
+    total(t + 1000, 3000);
+    CHECK(rack.energy() == Approx(75));
+    total(t + 1036, 1000);
+    CHECK(rack.energy() == Approx(95));
+
+    // time going backward restarts the integration
+    total(t + 500, 1000);
+    total(t + 536, 1000);
+    CHECK(rack.energy() == Approx(105));
+
+    // restored counter
+    rack.energy(1000);
+    total(t + 600, 1000);
+    CHECK(rack.energy() == Approx(1000));
+    CHECK(rack.energyMetric(t + 600).getValue() == Approx(1));
+    CHECK(rack.energyMetric(t + 600).getUnits() == "kWh");
+}
+
+TEST_CASE("tp unit input timestamps")
+{
+    const uint64_t now = 1600000000;
+    Clock::setVirtual(now);
+
+    TPowerSettings settings;
+    settings.statisticWindows    = {900};
+    settings.stalenessStatistics = true;
+
+    TPUnit rack;
+    rack.name("rack-1");
+    rack.settings(&settings);
+    rack.addPowerDevice("epdu-1");
+    rack.addPowerDevice("epdu-2");
+    rack.setMeasurement(MetricInfo("epdu-1", "realpower.default", "W", 100, now - 50, 300));
+    // epdu-2 reports phases only
+    rack.setMeasurement(MetricInfo("epdu-2", "realpower.output.L1", "W", 10, now - 5, 300));
+    rack.setMeasurement(MetricInfo("epdu-2", "realpower.output.L2", "W", 10, now - 20, 300));
+    rack.setMeasurement(MetricInfo("epdu-2", "realpower.output.L3", "W", 10, now - 10, 300));
+
+    rack.calculate(Quantity::REALPOWER_DEFAULT);
+    CHECK(rack.get(Quantity::REALPOWER_DEFAULT) == Approx(130));
+    CHECK(rack.inputs(Quantity::REALPOWER_DEFAULT).oldestTimestamp() == now - 50);
+    CHECK(rack.inputs(Quantity::REALPOWER_DEFAULT).newestTimestamp() == now - 5);
+    // the total itself is stamped by the calculation
+    CHECK(rack.getMetricInfo(Quantity::REALPOWER_DEFAULT).getTimestamp() == now);
+
+    // rolled-up total spans the inputs of the children
+    TPUnit rack2, row;
+    rack2.name("rack-2");
+    rack2.addPowerDevice("epdu-3");
+    rack2.setMeasurement(MetricInfo("epdu-3", "realpower.default", "W", 100, now - 2, 300));
+    rack2.calculate(Quantity::REALPOWER_DEFAULT);
+    row.name("row-1");
+    row.addChild(&rack);
+    row.addChild(&rack2);
+    row.rollup(quantity::mask(Quantity::REALPOWER_DEFAULT));
+    row.calculate(Quantity::REALPOWER_DEFAULT);
+    CHECK(row.inputs(Quantity::REALPOWER_DEFAULT).oldestTimestamp() == now - 50);
+    CHECK(row.inputs(Quantity::REALPOWER_DEFAULT).newestTimestamp() == now - 2);
+
+    // publishing records the lag behind the newest input and the age of the oldest one
+    rack.advertised(Quantity::REALPOWER_DEFAULT);
+    const auto& metrics = rack.statistics(now);
+    REQUIRE(metrics.size() == 7);
+    CHECK(metrics[3].getSource() == "realpower.default.publish_lag.avg_15m");
+    CHECK(metrics[3].getUnits() == "s");
+    CHECK(metrics[3].getValue() == Approx(5));
+    CHECK(metrics[6].getSource() == "realpower.default.input_age.max_15m");
+    CHECK(metrics[6].getValue() == Approx(50));
+    CHECK(rack.oldestInputMetric(now).getValue() == Approx(now - 50));
+
+    // unknown total has no inputs
+    Clock::set(now + 280);
+    rack.calculate(std::vector<Quantity>{Quantity::REALPOWER_DEFAULT}); // epdu-1 expired
+    CHECK(rack.quantityIsKnown(Quantity::REALPOWER_DEFAULT)); // the last total is still valid
+    CHECK(rack.inputs(Quantity::REALPOWER_DEFAULT).empty());
+    CHECK(std::isnan(rack.oldestInputMetric(now + 280).getValue()));
+
+    Clock::setSystem();
+}
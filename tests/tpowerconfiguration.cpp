@@ -0,0 +1,301 @@
+#include <catch2/catch.hpp>
+#include "helpers.h"
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+TEST_CASE_METHOD(ConfigurationFixture, "tpower configuration lazy calculation")
+{
+    TPowerSettings settings;
+    settings.lazyCalculation    = true;
+    settings.minPublishInterval = 100;
+    load(settings, {{"rack-1", {"epdu-1", "epdu-2"}}});
+
+    config.processMetric(s_metric("epdu-1", "realpower.default", 100));
+    config.processMetric(s_metric("epdu-2", "realpower.default", 200));
+    CHECK(sent.empty());
+
+    // query calculates the dirty unit
+    CHECK(config.query("rack-1", Quantity::REALPOWER_DEFAULT).getValue() == Approx(300));
+    CHECK(sent.empty());
+
+    config.publishPending();
+    REQUIRE(sent.size() == 1);
+    CHECK(sent[0].getElementName() == "rack-1");
+    CHECK(sent[0].getValue() == Approx(300));
+
+    // published just now, the unit stays pending
+    config.processMetric(s_metric("epdu-2", "realpower.default", 250));
+    config.publishPending();
+    CHECK(sent.size() == 1);
+
+    CHECK_THROWS(config.query("rack-2", Quantity::REALPOWER_DEFAULT));
+}
+
+TEST_CASE_METHOD(ConfigurationFixture, "tpower configuration multiple owners")
+{
+    // ups-1 powers both racks and both DCs
+    config.loadTopology({{"rack-1", {"ups-1", "epdu-1"}}, {"rack-2", {"ups-1"}}},
+        {{"datacenter-1", {"ups-1"}}, {"datacenter-2", {"ups-1", "ups-1"}}});
+
+    config.beginBatch();
+    config.processMetric(s_metric("epdu-1", "realpower.default", 100));
+    config.processMetric(s_metric("ups-1", "realpower.default", 1000));
+    CHECK(sent.empty());
+    config.endBatch();
+
+    // every unit is calculated and published once
+    std::map<std::string, double> totals;
+    for (const auto& M : sent) {
+        CHECK(M.getSource() == "realpower.default");
+        CHECK(totals.count(M.getElementName()) == 0);
+        totals[M.getElementName()] = M.getValue();
+    }
+    CHECK(totals.size() == 4);
+    CHECK(totals["rack-1"] == Approx(1100));
+    CHECK(totals["rack-2"] == Approx(1000));
+    CHECK(totals["datacenter-1"] == Approx(1000));
+    CHECK(totals["datacenter-2"] == Approx(1000));
+}
+
+TEST_CASE_METHOD(ConfigurationFixture, "tpower configuration quick reject")
+{
+    config.loadTopology({{"rack-1", {"epdu-1"}}}, {{"datacenter-1", {"ups-1"}}});
+
+    CHECK(config.interesting("epdu-1", "realpower.default"));
+    CHECK(!config.interesting("epdu-1", "realpower.input.L1")); // not a rack quantity
+    CHECK(config.interesting("ups-1", "realpower.input.L1"));
+    CHECK(config.interesting("ups-1", "voltage.input.L1-N")); // input of the apparent power
+    CHECK(!config.interesting("epdu-1", "voltage.input.L1-N"));
+    CHECK(!config.interesting("ups-1", "voltage.output.L1-N"));
+    CHECK(!config.interesting("sensor-1", "realpower.default"));
+
+    // the accepted quantity is processed without probing the filter again
+    Quantity quantity = config.interestingQuantity("ups-1", "realpower.input.L1");
+    REQUIRE(quantity == Quantity::REALPOWER_INPUT_L1);
+    CHECK(config.interestingQuantity("sensor-1", "realpower.default") == Quantity::UNKNOWN);
+    config.processMetric(MetricSample(s_metric("ups-1", "realpower.input.L1", 100)), quantity);
+    CHECK(config.query("datacenter-1", Quantity::REALPOWER_INPUT_L1).getValue() == Approx(100));
+
+    // topology reload rebuilds the filter
+    config.loadTopology({{"rack-1", {"epdu-2"}}}, {});
+    CHECK(!config.interesting("epdu-1", "realpower.default"));
+    CHECK(config.interesting("epdu-2", "realpower.default"));
+}
+
+TEST_CASE_METHOD(ConfigurationFixture, "tpower configuration memory report")
+{
+    // 10k devices: 1000 racks by 10 devices, 10 DCs
+    PowerTopology racks, dcs;
+    for (int i = 0; i < 10000; ++i) {
+        std::string device = "epdu-" + std::to_string(i);
+        racks["rack-" + std::to_string(i / 10)].push_back(device);
+        dcs["datacenter-" + std::to_string(i / 1000)].push_back(device);
+    }
+    config.loadTopology(racks, dcs);
+
+    auto before = config.memoryReport();
+    CHECK(before.devices == 20000);
+
+    for (int i = 0; i < 10000; ++i) {
+        std::string device = "epdu-" + std::to_string(i);
+        for (size_t q = 0; q < QUANTITY_COUNT; ++q) {
+            std::string quantity(quantity::names[q]);
+            config.processMetric(s_metric(device, quantity, 100));
+        }
+    }
+
+    // measurements are stored in place, one record per quantity in the map node of the device
+    auto after = config.memoryReport();
+    CHECK(after.unitsBytes == before.unitsBytes);
+    CHECK(after.mapsBytes == before.mapsBytes);
+    CHECK(sizeof(PowerDevice) <= QUANTITY_COUNT * sizeof(Measurement) + sizeof(int) * 2);
+    // ~707 B per device entry (14.1 MB) with 17 quantities
+    CHECK(after.bytesPerDevice() <= 720);
+}
+
+TEST_CASE_METHOD(ConfigurationFixture, "tpower configuration roll-up")
+{
+    LocationTopology locations;
+    // row-1 is powered by devices of its racks, so it's summed from them
+    locations.rows = {{"row-1", {"epdu-1", "epdu-2", "epdu-3"}}};
+    // room-1 is powered by the UPS feeding the row, it's summed from the devices
+    locations.rooms    = {{"room-1", {"ups-1"}}};
+    locations.children = {
+        {"row-1", {"rack-1", "rack-2"}}, {"room-1", {"row-1"}}, {"datacenter-1", {"room-1"}}};
+    config.loadTopology(
+        {{"rack-1", {"epdu-1", "epdu-2"}}, {"rack-2", {"epdu-3"}}}, {{"datacenter-1", {"ups-1"}}}, locations);
+
+    // devices of rolled-up units are not routed to them
+    CHECK(config.interesting("epdu-1", "realpower.default"));
+    CHECK(config.interesting("ups-1", "realpower.default"));
+    CHECK(config.interesting("ups-1", "realpower.input.L1"));
+
+    config.processMetric(s_metric("epdu-1", "realpower.default", 100));
+    config.processMetric(s_metric("epdu-2", "realpower.default", 200));
+    CHECK(published("row-1").empty()); // rack-2 is unknown
+    config.processMetric(s_metric("epdu-3", "realpower.default", 300));
+    config.processMetric(s_metric("ups-1", "realpower.default", 1000));
+
+    CHECK(config.query("rack-1", Quantity::REALPOWER_DEFAULT).getValue() == Approx(300));
+    CHECK(config.query("row-1", Quantity::REALPOWER_DEFAULT).getValue() == Approx(600));
+    CHECK(config.query("room-1", Quantity::REALPOWER_DEFAULT).getValue() == Approx(1000));
+    CHECK(config.query("datacenter-1", Quantity::REALPOWER_DEFAULT).getValue() == Approx(1000));
+    REQUIRE(published("row-1").size() == 1);
+    CHECK(published("row-1")[0] == Approx(600));
+    REQUIRE(published("datacenter-1").size() == 1);
+
+    // a change of the rack goes up to the row in the same batch (publishing is throttled)
+    config.beginBatch();
+    config.processMetric(s_metric("epdu-3", "realpower.default", 400));
+    config.endBatch();
+    CHECK(config.query("row-1", Quantity::REALPOWER_DEFAULT).getValue() == Approx(700));
+
+    // phases of the DC are not computed by rooms, they are summed from the devices
+    config.processMetric(s_metric("ups-1", "realpower.input.L1", 330));
+    CHECK(config.query("datacenter-1", Quantity::REALPOWER_INPUT_L1).getValue() == Approx(330));
+    CHECK_THROWS(config.query("row-1", Quantity::REALPOWER_INPUT_L1));
+}
+
+TEST_CASE_METHOD(ConfigurationFixture, "tpower configuration groups")
+{
+    LocationTopology locations;
+    // overlapping groups: tenant of two racks is summed from the racks, zone with a device from devices
+    locations.groups = {{"tenant:acme", {"rack-1", "rack-2"}}, {"cooling_zone:1", {"rack-2", "epdu-9"}}};
+    config.loadTopology(
+        {{"rack-1", {"epdu-1"}}, {"rack-2", {"epdu-2", "epdu-3"}}, {"rack-3", {"epdu-9"}}}, {}, locations);
+
+    CHECK(config.interesting("epdu-9", "realpower.default"));
+
+    config.processMetric(s_metric("epdu-1", "realpower.default", 100));
+    config.processMetric(s_metric("epdu-2", "realpower.default", 200));
+    config.processMetric(s_metric("epdu-3", "realpower.default", 300));
+    CHECK(config.query("tenant:acme", Quantity::REALPOWER_DEFAULT).getValue() == Approx(600));
+    CHECK_THROWS(config.query("cooling_zone:1", Quantity::REALPOWER_DEFAULT)); // epdu-9 is unknown
+
+    config.processMetric(s_metric("epdu-9", "realpower.default", 50));
+    CHECK(config.query("cooling_zone:1", Quantity::REALPOWER_DEFAULT).getValue() == Approx(550));
+
+    config.processMetric(s_metric("epdu-3", "realpower.default", 400));
+    CHECK(config.query("tenant:acme", Quantity::REALPOWER_DEFAULT).getValue() == Approx(700));
+    CHECK(config.query("cooling_zone:1", Quantity::REALPOWER_DEFAULT).getValue() == Approx(650));
+}
+
+TEST_CASE_METHOD(ConfigurationFixture, "tpower configuration group with other members")
+{
+    LocationTopology locations;
+    // a server, a rack without power devices, an unknown asset and a nested group are ignored
+    locations.groups = {{"tenant:acme", {"rack-1", "epdu-2", "server-1", "rack-2", "rack-9", "zone:1"}}};
+    config.loadTopology({{"rack-1", {"epdu-1"}}, {"rack-2", {}}, {"rack-3", {"epdu-2"}}}, {}, locations);
+
+    CHECK(!config.interesting("server-1", "realpower.default"));
+
+    config.processMetric(s_metric("epdu-1", "realpower.default", 100));
+    config.processMetric(s_metric("epdu-2", "realpower.default", 200));
+    CHECK(config.query("tenant:acme", Quantity::REALPOWER_DEFAULT).getValue() == Approx(300));
+    REQUIRE(published("tenant:acme").size() == 1);
+    CHECK(published("tenant:acme")[0] == Approx(300));
+}
+
+TEST_CASE_METHOD(ConfigurationFixture, "tpower configuration energy")
+{
+    TPowerSettings settings;
+    settings.publishEnergy = true;
+    load(settings, {{"rack-1", {"epdu-1"}}});
+
+    config.processMetric(s_metric("epdu-1", "realpower.default", 100));
+    REQUIRE(sent.size() == 2);
+    CHECK(sent[1].getSource() == "energy.default");
+    CHECK(sent[1].getElementName() == "rack-1");
+    CHECK(sent[1].getValue() == 0);
+}
+
+TEST_CASE_METHOD(ConfigurationFixture, "tpower configuration oldest input")
+{
+    TPowerSettings settings;
+    settings.publishOldestInput = true;
+    load(settings, {{"rack-1", {"epdu-1", "epdu-2"}}});
+
+    uint64_t now = uint64_t(::time(nullptr));
+    config.processMetric(MetricInfo("epdu-1", "realpower.default", "W", 100, now - 30, 300));
+    config.processMetric(MetricInfo("epdu-2", "realpower.default", "W", 100, now - 10, 300));
+    REQUIRE(sent.size() == 2);
+    CHECK(sent[0].getSource() == "realpower.default");
+    CHECK(sent[1].getSource() == "realpower.default.oldest_input");
+    CHECK(sent[1].getElementName() == "rack-1");
+    CHECK(sent[1].getValue() == Approx(double(now - 30)));
+}
+
+TEST_CASE_METHOD(ConfigurationFixture, "tpower configuration thresholds")
+{
+    TPowerSettings settings;
+    settings.thresholds["rack-1"].high       = 1000;
+    settings.thresholds["rack-1"].low        = 100;
+    settings.thresholds["rack-1"].hysteresis = 50;
+    load(settings, {{"rack-1", {"epdu-1"}}, {"rack-2", {"epdu-2"}}});
+
+    config.processMetric(s_metric("epdu-1", "realpower.default", 500));
+    config.processMetric(s_metric("epdu-2", "realpower.default", 5000)); // no thresholds
+    CHECK(alerts.empty());
+
+    // crossing is reported in the same step
+    config.processMetric(s_metric("epdu-1", "realpower.default", 1200));
+    REQUIRE(alerts.size() == 1);
+    CHECK(alerts[0].unit == "rack-1");
+    CHECK(alerts[0].limit == ThresholdState::HIGH);
+    CHECK(alerts[0].active);
+    CHECK(alerts[0].value == Approx(1200));
+
+    // hysteresis
+    config.processMetric(s_metric("epdu-1", "realpower.default", 980));
+    CHECK(alerts.size() == 1);
+    config.processMetric(s_metric("epdu-1", "realpower.default", 900));
+    REQUIRE(alerts.size() == 2);
+    CHECK(!alerts[1].active);
+
+    // straight from high to low
+    config.processMetric(s_metric("epdu-1", "realpower.default", 2000));
+    config.processMetric(s_metric("epdu-1", "realpower.default", 50));
+    REQUIRE(alerts.size() == 5);
+    CHECK(!alerts[3].active);
+    CHECK(alerts[3].limit == ThresholdState::HIGH);
+    CHECK(alerts[4].active);
+    CHECK(alerts[4].limit == ThresholdState::LOW);
+}
+
+TEST_CASE_METHOD(ConfigurationFixture, "tpower configuration thresholds over reload")
+{
+    TPowerSettings settings;
+    for (const char* rack : {"rack-1", "rack-2", "rack-3"}) {
+        settings.thresholds[rack].high = 1000;
+    }
+    load(settings, {{"rack-1", {"epdu-1"}}, {"rack-2", {"epdu-2"}}, {"rack-3", {"epdu-3"}}});
+    for (const char* device : {"epdu-1", "epdu-2", "epdu-3"}) {
+        config.processMetric(s_metric(device, "realpower.default", 1200));
+    }
+    REQUIRE(alerts.size() == 3);
+
+    // the active alert isn't sent again, the alert of the removed unit is resolved
+    alerts.clear();
+    config.loadTopology({{"rack-1", {"epdu-1"}}, {"rack-3", {"epdu-3"}}}, {});
+    REQUIRE(alerts.size() == 1);
+    CHECK(alerts[0].unit == "rack-2");
+    CHECK(!alerts[0].active);
+    CHECK(alerts[0].threshold == Approx(1000));
+    config.processMetric(s_metric("epdu-1", "realpower.default", 1200));
+    CHECK(alerts.size() == 1);
+    config.processMetric(s_metric("epdu-1", "realpower.default", 500));
+    REQUIRE(alerts.size() == 2);
+    CHECK(alerts[1].unit == "rack-1");
+    CHECK(!alerts[1].active);
+
+    // the alert of the removed threshold is resolved
+    settings.thresholds.erase("rack-3");
+    config.settings(settings);
+    REQUIRE(alerts.size() == 3);
+    CHECK(alerts[2].unit == "rack-3");
+    CHECK(!alerts[2].active);
+    config.processMetric(s_metric("epdu-3", "realpower.default", 1500));
+    CHECK(alerts.size() == 3);
+}
@@ -0,0 +1,60 @@
+#include <catch2/catch.hpp>
+#include "src/stagestats.h"
+#include "src/tracer.h"
+#include <string>
+#include <thread>
+
+static size_t s_count(const std::string& text, const std::string& pattern)
+{
+    size_t count = 0;
+    for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1)) {
+        count++;
+    }
+    return count;
+}
+
+TEST_CASE("tracer")
+{
+    Tracer::clear();
+    Tracer::enable(false);
+    {
+        TraceSpan span("disabled", "test");
+    }
+    CHECK(Tracer::json().find("\"disabled\"") == std::string::npos);
+
+    Tracer::enable(true);
+    Tracer::threadName("test \"main\"");
+    {
+        TraceSpan span("cycle", "test", "rack-1");
+        StageTimer timer(Stage::CALCULATE, "rack-2"); // stages are traced too
+    }
+    std::thread worker([]() {
+        Tracer::threadName("worker");
+        TraceSpan span("work", "test");
+    });
+    worker.join();
+    Tracer::enable(false);
+
+    std::string json = Tracer::json();
+    CHECK(json.find("{\"traceEvents\":[") == 0);
+    CHECK(json.find("\"name\":\"cycle\",\"cat\":\"test\",\"ph\":\"X\"") != std::string::npos);
+    CHECK(json.find("\"args\":{\"detail\":\"rack-1\"}") != std::string::npos);
+    CHECK(json.find("\"name\":\"calculate\",\"cat\":\"stage\"") != std::string::npos);
+    CHECK(json.find("\"args\":{\"name\":\"test \\\"main\\\"\"}") != std::string::npos); // escaped
+    CHECK(json.find("\"args\":{\"name\":\"worker\"}") != std::string::npos);
+    CHECK(json.find("\"name\":\"work\"") != std::string::npos);
+    CHECK(json.find("\"disabled\"") == std::string::npos);
+
+    // the oldest spans are overwritten
+    Tracer::clear();
+    Tracer::enable(true);
+    for (size_t i = 0; i < Tracer::CAPACITY + 10; ++i) {
+        TraceSpan span("overflow", "test");
+    }
+    Tracer::enable(false);
+    CHECK(s_count(Tracer::json(), "\"name\":\"overflow\"") == Tracer::CAPACITY);
+
+    Tracer::clear();
+    CHECK(s_count(Tracer::json(), "\"ph\":\"X\"") == 0);
+    CHECK(s_count(Tracer::json(), "\"ph\":\"M\"") >= 2); // thread names are kept
+}
@@ -0,0 +1,31 @@
+#include <catch2/catch.hpp>
+#include "src/watchdog.h"
+#include <string>
+
+TEST_CASE("watchdog heartbeats")
+{
+    Watchdog watchdog;
+    CHECK(watchdog.limit(Heartbeat::MLM) == Watchdog::DEFAULT_LIMITS[size_t(Heartbeat::MLM)]);
+    CHECK(watchdog.limit(Heartbeat::PUBLISH) == 0);
+
+    watchdog.limits({{600, 60, 900, 0}});
+    for (size_t i = 0; i < HEARTBEAT_COUNT; ++i) {
+        watchdog.beat(Heartbeat(i));
+    }
+    uint64_t now = Watchdog::now();
+    CHECK(watchdog.check(now) == HEARTBEAT_COUNT);
+    CHECK(watchdog.lag(Heartbeat::SHM_POLL, now + 30) >= 30);
+    CHECK(watchdog.lag(Heartbeat::SHM_POLL, now + 30) <= 31);
+
+    // the stage with the shortest limit expires first, publishing is not checked
+    CHECK(watchdog.check(now + 120) == size_t(Heartbeat::SHM_POLL));
+    CHECK(watchdog.check(now + 1000) == size_t(Heartbeat::MLM));
+    watchdog.limits({{0, 0, 0, 0}});
+    CHECK(watchdog.check(now + 1000) == HEARTBEAT_COUNT);
+
+    CHECK(std::string(Watchdog::name(Heartbeat::CALCULATION)) == "calculation");
+
+    // the thread doesn't block the shutdown
+    watchdog.start();
+    watchdog.stop();
+}